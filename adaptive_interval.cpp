@@ -0,0 +1,65 @@
+#include "adaptive_interval.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glog/logging.h>
+
+AdaptiveInterval::AdaptiveInterval()
+  : _last_tick(Clock::now()), _last_report(_last_tick), _start(_last_tick) {}
+
+std::chrono::milliseconds AdaptiveInterval::update(
+  uint32_t temp, const leviathan_config &config) {
+  const std::chrono::milliseconds min_interval(config.min_interval_);
+  const std::chrono::milliseconds max_interval(config.max_interval_);
+  const auto                      now = Clock::now();
+  const double dt = std::chrono::duration<double>(now - _last_tick).count();
+  ++_ticks;
+
+  const bool blind = temp > kMaxPlausibleTemp;
+  if (blind) {
+    // Don't back off while blind
+    _interval = min_interval;
+  } else if (_interval.count() == 0) {
+    // First sample, nothing to differentiate against yet
+    _interval = min_interval;
+  } else {
+    const double slope = (static_cast<double>(temp) - _last_temp) / dt;
+    _slope += kSlopeSmoothing * (slope - _slope);
+    if (_slope >= kFastRiseSlope) {
+      _interval = min_interval;
+    } else if (std::fabs(_slope) <= kSteadySlope) {
+      // At least a millisecond, a quarter of a short interval rounds to 0
+      _interval = std::max(_interval + std::chrono::milliseconds(1),
+                           _interval * 5 / 4);
+    } else {
+      _interval = _interval / 2;
+    }
+  }
+  _interval = std::max(min_interval, std::min(max_interval, _interval));
+  if (!blind) {
+    // The next slope is taken against the last sample that was read, over
+    // the whole time since
+    _last_temp = temp;
+    _last_tick = now;
+  }
+
+  VLOG(2) << "Temperature slope " << _slope << "C/s, next tick in "
+          << _interval.count() << "ms";
+  if (now - _last_report >= kSavingsReportPeriod) {
+    reportSavings(config);
+    _last_report = now;
+  }
+  return _interval;
+}
+
+void AdaptiveInterval::reportSavings(const leviathan_config &config) const {
+  const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+    Clock::now() - _start);
+  const int64_t fixed_ticks = elapsed.count() / config.interval_;
+  const int64_t saved       = std::max<int64_t>(0, fixed_ticks - _ticks);
+  LOG(INFO) << "Adaptive interval ran " << _ticks << " ticks in "
+            << elapsed.count() / 1000 << "s where a fixed " << config.interval_
+            << "ms interval would have run " << fixed_ticks << ", saving "
+            << saved << " wakeups and " << saved * kUsbTransfersPerTick
+            << " usb transfers";
+}
@@ -0,0 +1,45 @@
+#ifndef ADAPTIVE_INTERVAL_H
+#define ADAPTIVE_INTERVAL_H
+
+#include <chrono>
+#include <cstdint>
+
+#include "leviathan_config.hpp"
+
+// Slopes are in degrees C per second, of the EWMA smoothed derivative
+#define kSteadySlope 0.1
+#define kFastRiseSlope 1.0
+#define kSlopeSmoothing 0.5
+// Transfers a steady tick performs: BEGIN + 2 speeds + status. The color only
+// goes out when it changed, which a tick saved by stretching rarely would have.
+#define kUsbTransfersPerTick 4
+#define kSavingsReportPeriod std::chrono::minutes(15)
+
+// Stretches the tick period toward max_interval_ while the control
+// temperature holds steady, and snaps back to min_interval_ as soon as it
+// starts climbing quickly. Also keeps count of the ticks actually run against
+// what the fixed interval_ would have needed over the same time.
+class AdaptiveInterval {
+ public:
+  AdaptiveInterval();
+
+  // Feeds the control temperature of the tick that just ran, returns the
+  // delay until the next one
+  std::chrono::milliseconds update(uint32_t                temp,
+                                   const leviathan_config &config);
+  // Logs the wakeups and usb transfers saved so far
+  void reportSavings(const leviathan_config &config) const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  std::chrono::milliseconds _interval{0};
+  double                    _slope{0.0};
+  uint32_t                  _last_temp{0};
+  Clock::time_point         _last_tick;
+  Clock::time_point         _last_report;
+  Clock::time_point         _start;
+  uint64_t                  _ticks{0};
+};
+
+#endif  // ADAPTIVE_INTERVAL_H
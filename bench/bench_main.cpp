@@ -0,0 +1,17 @@
+#include <benchmark/benchmark.h>
+#include <glog/logging.h>
+
+// Same as BENCHMARK_MAIN, with the per tick INFO logging of the daemon
+// silenced so it doesn't end up in the measurements
+int main(int argc, char *argv[]) {
+  FLAGS_logtostderr = 1;
+  FLAGS_minloglevel = google::WARNING;
+  google::InitGoogleLogging(argv[0]);
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+    return 1;
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,47 @@
+#include <benchmark/benchmark.h>
+#include <filesystem>
+#include <string.h>
+
+#include "kraken_driver.hpp"
+#include "leviathan_service.hpp"
+
+#define kBenchConfigFile LEVD_SOURCE_DIR "/bench/levd_bench.cfg"
+
+static void BM_ParseStatus(benchmark::State &state) {
+  unsigned char status[32];
+  memset(status, 0, sizeof(status));
+  status[0]  = 0x03;  // 800rpm fan
+  status[1]  = 0x20;
+  status[8]  = 0x0A;  // 2600rpm pump
+  status[9]  = 0x28;
+  status[10] = 31;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(KrakenDriver::parseStatus(status));
+  }
+}
+BENCHMARK(BM_ParseStatus);
+
+// Formats and atomically replaces the file with one block per Kraken
+static void BM_UpdateConkyFile(benchmark::State &state) {
+  SimulatedService service(kBenchConfigFile);
+  service.tick();
+  const std::string path =
+    (std::filesystem::temp_directory_path() / "levd_bench_conky").string();
+  for (auto _ : state) {
+    service.writeConkyFile(path);
+  }
+  std::filesystem::remove(path);
+}
+BENCHMARK(BM_UpdateConkyFile);
+
+// A whole control tick against simulated Krakens with no bus latency: config
+// check, color and speed transfers, sensors, controllers, status pages and
+// metrics for every device. tests/control_tick_test checks that it doesn't
+// allocate.
+static void BM_ControlTick(benchmark::State &state) {
+  SimulatedService service(kBenchConfigFile);
+  for (auto _ : state) {
+    service.tick();
+  }
+}
+BENCHMARK(BM_ControlTick);
@@ -0,0 +1,53 @@
+#include <benchmark/benchmark.h>
+#include <yaml-cpp/yaml.h>
+
+#include "fan_controller.hpp"
+#include "leviathan_config.hpp"
+
+// Configs shipped in the source tree, the default one and the one driving
+// the simulated benchmarks
+static const char *const kConfigFiles[] = {LEVD_SOURCE_DIR "/config/levd.cfg",
+                                           LEVD_SOURCE_DIR
+                                           "/bench/levd_bench.cfg"};
+
+static const char *const kFanProfile =
+  "[[30, 30], [35, 40], [40, 60], [42, 70], [43, 80], [45, 100]]";
+
+static void BM_SlopeFunction(benchmark::State &state) {
+  const LineFunction line = slope_function(Point(35, 40), Point(40, 60));
+  int32_t            x    = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(line(35 + x));
+    x = (x + 1) % 6;
+  }
+}
+BENCHMARK(BM_SlopeFunction);
+
+static void BM_ConfigureProfile(benchmark::State &state) {
+  const YAML::Node profile = YAML::Load(kFanProfile);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(configure_profile(profile));
+  }
+}
+BENCHMARK(BM_ConfigureProfile);
+
+// One lookup per tick, sweeps the whole table including out of range temps
+static void BM_NextSpeed(benchmark::State &state) {
+  const CompiledProfile profile = configure_profile(YAML::Load(kFanProfile));
+  uint32_t              temp    = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(next_speed(profile, temp));
+    temp = (temp + 1) % (kProfileTableSize + 10);
+  }
+}
+BENCHMARK(BM_NextSpeed);
+
+// Runs on the watcher thread for every rewrite of the config file
+static void BM_ParseConfigFile(benchmark::State &state) {
+  const char *const path = kConfigFiles[state.range(0)];
+  state.SetLabel(path);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(try_parse_config_file(path));
+  }
+}
+BENCHMARK(BM_ParseConfigFile)->DenseRange(0, 1);
@@ -0,0 +1,24 @@
+#include <benchmark/benchmark.h>
+#include <exception>
+#include <memory>
+
+#include "cpu_temperature_monitor.hpp"
+#include "hwmon_temperature_monitor.hpp"
+
+// Compares one package temperature sample through libsensors against a pread
+// on an already open hwmon file. Skipped when the machine lacks the chip.
+template <class Monitor>
+static void BM_PackageTemperature(benchmark::State &state) {
+  std::unique_ptr<Monitor> monitor;
+  try {
+    monitor = std::make_unique<Monitor>();
+  } catch (std::exception &e) {
+    state.SkipWithError(e.what());
+    return;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(monitor->getPackageIdTemperature());
+  }
+}
+BENCHMARK_TEMPLATE(BM_PackageTemperature, CpuTemperatureMonitor);
+BENCHMARK_TEMPLATE(BM_PackageTemperature, HwmonTemperatureMonitor);
@@ -0,0 +1,71 @@
+#ifndef COLOR_PACKET_H
+#define COLOR_PACKET_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string.h>
+
+#include "constants.h"
+
+#define kColorPacketSize sizeof(kDefaultColor)
+
+// Effects the Kraken animates on its own once the color packet is sent
+enum class LightingMode {
+  STATIC,     // Main color
+  ALTERNATE,  // Main and alternate color, switching every interval
+  BLINK,      // Main color, on and off every interval
+  OFF
+};
+
+// Typed builder for the 19 byte color packet, starting from kDefaultColor:
+//  0     KRAKEN_COLOR_CODE
+//  1-3   main color, RGB
+//  4-6   alternate color, RGB
+//  11-12 interval in seconds
+//  13    enabled
+//  14    alternating
+//  15    blinking
+// Other bytes are kept as in kDefaultColor
+class ColorPacket {
+ public:
+  ColorPacket() { memcpy(_data, kDefaultColor, kColorPacketSize); }
+
+  ColorPacket &color(uint32_t rgb) {
+    setRgb(1, rgb);
+    return *this;
+  }
+  ColorPacket &alternateColor(uint32_t rgb) {
+    setRgb(4, rgb);
+    return *this;
+  }
+  ColorPacket &interval(uint8_t seconds) {
+    _data[11] = seconds;
+    _data[12] = seconds;
+    return *this;
+  }
+  ColorPacket &mode(LightingMode mode) {
+    _data[13] = mode != LightingMode::OFF;
+    _data[14] = mode == LightingMode::ALTERNATE;
+    _data[15] = mode == LightingMode::BLINK;
+    return *this;
+  }
+
+  const unsigned char *data() const { return _data; }
+  size_t               size() const { return kColorPacketSize; }
+
+  bool operator==(const ColorPacket &other) const {
+    return memcmp(_data, other._data, kColorPacketSize) == 0;
+  }
+  bool operator!=(const ColorPacket &other) const { return !(*this == other); }
+
+ private:
+  void setRgb(size_t offset, uint32_t rgb) {
+    _data[offset]     = (rgb & 0x00FF0000) >> 16;
+    _data[offset + 1] = (rgb & 0x0000FF00) >> 8;
+    _data[offset + 2] = rgb & 0x000000FF;
+  }
+
+  unsigned char _data[kColorPacketSize];
+};
+
+#endif  // COLOR_PACKET_H
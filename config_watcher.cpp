@@ -0,0 +1,84 @@
+#include "config_watcher.hpp"
+
+#include <glog/logging.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#define kConfigWatchMask (IN_CLOSE_WRITE | IN_MOVED_TO)
+
+ConfigWatcher::ConfigWatcher(const char *const path)
+  : _path(path), _config(std::make_shared<leviathan_config>(
+                   parse_config_file(path))) {
+  const auto slash = _path.find_last_of('/');
+  _dirname  = slash == std::string::npos ? "." : _path.substr(0, slash);
+  _basename = slash == std::string::npos ? _path : _path.substr(slash + 1);
+
+  _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  PCHECK(_inotify_fd >= 0) << "Failed to initialize inotify";
+  // Watch the directory, editors commonly replace the file by renaming
+  PCHECK(inotify_add_watch(_inotify_fd, _dirname.c_str(), kConfigWatchMask)
+         >= 0)
+    << "Failed to watch " << _dirname;
+  _stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  PCHECK(_stop_fd >= 0) << "Failed to create eventfd";
+  _thread = std::thread(&ConfigWatcher::watch, this);
+}
+
+ConfigWatcher::~ConfigWatcher() {
+  const uint64_t one = 1;
+  if (write(_stop_fd, &one, sizeof(one)) != sizeof(one)) {
+    PLOG(ERROR) << "Failed to signal config watcher shutdown";
+  }
+  _thread.join();
+  close(_stop_fd);
+  close(_inotify_fd);
+}
+
+/** ********** Private interface ********** */
+
+void ConfigWatcher::watch() {
+  alignas(struct inotify_event) char buffer[4096];
+  struct pollfd fds[2] = {{_inotify_fd, POLLIN, 0}, {_stop_fd, POLLIN, 0}};
+  while (true) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      PLOG(ERROR) << "poll() failed, config reload disabled";
+      return;
+    }
+    if (fds[1].revents & POLLIN) {
+      return;
+    }
+    bool    modified = false;
+    ssize_t len;
+    while ((len = read(_inotify_fd, buffer, sizeof(buffer))) > 0) {
+      for (char *ptr = buffer; ptr < buffer + len;) {
+        const auto *event = reinterpret_cast<struct inotify_event *>(ptr);
+        if (event->len > 0 && _basename == event->name) {
+          modified = true;
+        }
+        ptr += sizeof(struct inotify_event) + event->len;
+      }
+    }
+    if (modified) {
+      reload();
+    }
+  }
+}
+
+void ConfigWatcher::reload() {
+  LOG(INFO) << "Detected modifications to config file, updating preferences...";
+  auto options = try_parse_config_file(_path.c_str());
+  if (!options) {
+    LOG(ERROR) << "Keeping previous configuration";
+    return;
+  }
+  std::atomic_store(
+    &_config,
+    std::shared_ptr<const leviathan_config>(
+      std::make_shared<leviathan_config>(std::move(*options))));
+  _generation.fetch_add(1, std::memory_order_release);
+}
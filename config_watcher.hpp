@@ -0,0 +1,46 @@
+#ifndef CONFIG_WATCHER_H
+#define CONFIG_WATCHER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "leviathan_config.hpp"
+
+// Keeps an immutable snapshot of the latest valid config. The directory
+// holding the config file is watched with inotify from a background thread,
+// which parses and validates every rewrite and only then publishes it. An
+// invalid or half written file is logged and the previous snapshot is kept.
+class ConfigWatcher {
+ public:
+  // The initial parse is fatal on error, there is no last good config yet
+  explicit ConfigWatcher(const char *const path);
+  ConfigWatcher(const ConfigWatcher &) = delete;
+  ~ConfigWatcher();
+
+  // Bumped after every successful reload, cheap enough to check every tick
+  uint64_t generation() const {
+    return _generation.load(std::memory_order_acquire);
+  }
+  std::shared_ptr<const leviathan_config> current() const {
+    return std::atomic_load(&_config);
+  }
+
+ private:
+  void watch();
+  void reload();
+
+  const std::string _path;
+  std::string       _dirname;
+  std::string       _basename;
+
+  std::shared_ptr<const leviathan_config> _config;
+  std::atomic<uint64_t>                   _generation{0};
+
+  int         _inotify_fd{-1};
+  int         _stop_fd{-1};  // eventfd, wakes the watcher for shutdown
+  std::thread _thread;
+};
+
+#endif  // CONFIG_WATCHER_H
@@ -11,9 +11,15 @@
 #define KRAKEN_INIT 0x0002
 #define KRAKEN_BEGIN 0x0001
 
-const char *const kDefaultCPUTempFile = "/sys/class/hwmon/hwmon0/temp1_input";
+#define kKrakenUsbTimeout 5000
+
+const char *const kDefaultHwmonDir    = "/sys/class/hwmon";
 const char *const kDefaultConfigFile  = "/etc/leviathan/levd.cfg";
-const char *const kDefaultConkyFile  = "/etc/leviathan/levd.cfg";
+const char *const kDefaultConkyFile  = "/etc/leviathan/conky_levd.updates";
+const char *const kDefaultStatusShm  = "/levd_status";
+const char *const kSimulatedStatusShm = "/levd_sim_status";
+const char *const kDefaultTelemetryFile = "/var/lib/leviathan/telemetry.bin";
+const char *const kDefaultFastStartFile = "/var/lib/leviathan/fast_start";
 
 const unsigned char kDefaultColor[19] = {
   KRAKEN_COLOR_CODE, 0xff, 0xff, 0xff,
@@ -22,10 +28,6 @@ const unsigned char kDefaultColor[19] = {
   0x01, 0x00, 0x01
 };
 
-// 11 - interval
-// 12 - interval
-// 13 - enabled
-// 14 - altBit
-// 15 - blinking
+// Byte layout in color_packet.hpp
 
 #endif  // CONSTANTS_H
@@ -0,0 +1,159 @@
+#include "control_server.hpp"
+#include "unix_socket.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <glog/logging.h>
+#include <sstream>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define kMaxCommandLength 256
+
+ControlServer::ControlServer(const std::string &path,
+                             EventLoop &        loop,
+                             OverrideMailbox &  mailbox)
+  : _path(path)
+  , _loop(loop)
+  , _mailbox(mailbox)
+  , _fd(listen_unix_socket(path, 0600)) {
+  _loop.add(_fd, EPOLLIN, [this](uint32_t) { accept(); });
+  LOG(INFO) << "Accepting overrides on " << path;
+}
+
+ControlServer::~ControlServer() {
+  for (const auto &client : _pending) {
+    _loop.remove(client.first);
+    close(client.first);
+  }
+  _loop.remove(_fd);
+  close(_fd);
+  unlink(_path.c_str());
+}
+
+/** ********** Private interface ********** */
+
+void ControlServer::accept() {
+  int client;
+  while ((client = accept4(_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC))
+         >= 0) {
+    _pending[client];
+    _loop.add(client, EPOLLIN | EPOLLRDHUP,
+              [this, client](uint32_t) { receive(client); });
+  }
+}
+
+void ControlServer::receive(int client) {
+  std::string &pending = _pending[client];
+  char         buffer[kMaxCommandLength];
+  ssize_t      len;
+  while ((len = read(client, buffer, sizeof(buffer))) > 0) {
+    pending.append(buffer, len);
+  }
+  if (len < 0 && errno != EAGAIN) {
+    disconnect(client);
+    return;
+  }
+
+  size_t newline;
+  while ((newline = pending.find('\n')) != std::string::npos) {
+    const std::string reply = execute(pending.substr(0, newline)) + "\n";
+    pending.erase(0, newline + 1);
+    if (send(client, reply.data(), reply.size(), MSG_NOSIGNAL) < 0) {
+      disconnect(client);
+      return;
+    }
+  }
+  if (len == 0 || pending.size() > kMaxCommandLength) {
+    disconnect(client);
+  }
+}
+
+void ControlServer::disconnect(int client) {
+  _loop.remove(client);
+  close(client);
+  _pending.erase(client);
+}
+
+std::string ControlServer::execute(const std::string &line) {
+  override_command command;
+  std::string      error;
+  if (!parse_override_command(line, command, error)) {
+    return "error: " + error;
+  }
+  if (!_mailbox.post(command)) {
+    return "error: too many pending commands, try again";
+  }
+  return "ok";
+}
+
+/** ********** Public interface ********** */
+
+bool parse_override_command(const std::string &line,
+                            override_command & command,
+                            std::string &      error) {
+  std::istringstream words(line);
+  std::string        verb, value, extra;
+  uint32_t           ttl = 0;
+  words >> verb >> value;
+
+  command = {OverrideKind::COUNT, false, 0, 0};
+  if (verb == "clear") {
+    command.clear = true;
+    if (value.empty()) {
+      return true;
+    }
+    for (const auto kind : {OverrideKind::FAN, OverrideKind::PUMP,
+                            OverrideKind::COLOR, OverrideKind::TEMP_SOURCE}) {
+      if (value == overrideKindToString(kind)) {
+        command.kind = kind;
+        return true;
+      }
+    }
+    error = "unknown override " + value;
+    return false;
+  }
+
+  if (!(words >> ttl) || words >> extra) {
+    error = "expected <command> <value> <ttl seconds>";
+    return false;
+  }
+  if (ttl == 0 || ttl > kMaxOverrideTtl) {
+    error = "ttl must be between 1 and " + std::to_string(kMaxOverrideTtl);
+    return false;
+  }
+  command.ttl_ms = ttl * 1000;
+
+  char *end = nullptr;
+  if (verb == "fan" || verb == "pump") {
+    command.kind  = verb == "fan" ? OverrideKind::FAN : OverrideKind::PUMP;
+    command.value = strtoul(value.c_str(), &end, 10);
+    // The Kraken only takes multiples of 5, KrakenDriver CHECKs anything else
+    if (*end != '\0' || command.value < kMinDuty || command.value > kMaxDuty
+        || command.value % 5 != 0) {
+      error = "duty must be a multiple of 5 between "
+              + std::to_string(kMinDuty) + " and " + std::to_string(kMaxDuty);
+      return false;
+    }
+  } else if (verb == "color") {
+    command.kind  = OverrideKind::COLOR;
+    command.value = strtoul(value.c_str(), &end, 0);
+    if (value.empty() || *end != '\0' || command.value > 0xFFFFFF) {
+      error = "color must be an RGB value such as 0x00FF00";
+      return false;
+    }
+  } else if (verb == "source") {
+    command.kind = OverrideKind::TEMP_SOURCE;
+    if (value != "cpu" && value != "liquid") {
+      error = "source must be cpu or liquid";
+      return false;
+    }
+    command.value = static_cast<uint32_t>(stringToTempSource(value));
+  } else {
+    error = "unknown command " + verb;
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,44 @@
+#ifndef CONTROL_SERVER_H
+#define CONTROL_SERVER_H
+
+#include <string>
+#include <unordered_map>
+
+#include "event_loop.hpp"
+#include "overrides.hpp"
+
+// Line based command protocol on a unix domain socket for temporary
+// overrides, every command carries a TTL in seconds:
+//   fan <percent> <ttl>      pump <percent> <ttl>
+//   color <rgb> <ttl>        source <cpu|liquid> <ttl>
+//   clear [fan|pump|color|source]
+// Each line is answered with "ok" or "error: <reason>". Parsed commands are
+// posted to the mailbox and take effect on the next tick.
+class ControlServer {
+ public:
+  // Throws std::runtime_error if the socket can't be bound
+  ControlServer(const std::string &path,
+                EventLoop &        loop,
+                OverrideMailbox &  mailbox);
+  ControlServer(const ControlServer &) = delete;
+  ~ControlServer();
+
+ private:
+  void accept();
+  void receive(int client);
+  void disconnect(int client);
+  std::string execute(const std::string &line);
+
+  const std::string                    _path;
+  EventLoop &                          _loop;
+  OverrideMailbox &                    _mailbox;
+  int                                  _fd;
+  std::unordered_map<int, std::string> _pending;  // Partial line per client
+};
+
+// Returns false and sets error if line is not a valid command
+bool parse_override_command(const std::string &line,
+                            override_command & command,
+                            std::string &      error);
+
+#endif  // CONTROL_SERVER_H
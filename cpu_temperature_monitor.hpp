@@ -1,4 +1,5 @@
 #pragma once
+#include <algorithm>
 #include <cstring>
 #include <glog/logging.h>
 #include <limits>
@@ -6,7 +7,10 @@
 #include <string>
 #include <vector>
 
-class CpuTemperatureMonitor {
+#include "temperature_monitor.hpp"
+
+// lm-sensors backed reader, only supports the Intel coretemp chip
+class CpuTemperatureMonitor : public TemperatureMonitor {
  public:
   // TODO: Disable copy, permit move semantics
   CpuTemperatureMonitor()
@@ -15,22 +19,30 @@ class CpuTemperatureMonitor {
   ~CpuTemperatureMonitor() { sensors_cleanup(); }
 
   // Returns the temperature of the CPU heat sink itself
-  uint32_t getPackageIdTemperature() const { return temperatureForCoreId(0); }
+  uint32_t getPackageIdTemperature() const override {
+    return temperatureForCoreId(0);
+  }
   // Returns the temperature of an individual core
-  uint32_t getCoreIdTemperature(uint8_t core_id) const {
+  uint32_t getCoreIdTemperature(uint8_t core_id) const override {
     // On bad input, normalize instead of returning -1
-    if (core_id > coreCount()) {
-      core_id = coreCount();
-    } else if (core_id < 0) {
-      core_id = 0;  // 0th core, package_id is 0
+    if (core_id >= coreCount()) {
+      core_id = coreCount() - 1;
     }
-    return temperatureForCoreId(core_id + 1);
+    return temperatureForCoreId(core_id + 1);  // package_id is 0
   }
   // Returns the number of physical cores in the CPU
-  size_t coreCount() const { return subfeatures_.size() - 1; }
+  size_t coreCount() const override { return subfeatures_.size() - 1; }
+  size_t sampleCoreTemperatures(int32_t *out,
+                                size_t   capacity) const override {
+    const size_t n = std::min(coreCount(), capacity);
+    for (size_t i = 0; i < n; ++i) {
+      out[i] = temperatureForCoreId(i + 1);
+    }
+    return n;
+  }
 
  private:
-  uint32_t temperatureForCoreId(uint8_t id) const {
+  uint32_t temperatureForCoreId(size_t id) const {
     const sensors_subfeature *const subfeature = subfeatures_[id];
     double                          value;
     if (sensors_get_value(cn_, subfeature->number, &value) != 0) {
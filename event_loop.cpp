@@ -0,0 +1,133 @@
+#include "event_loop.hpp"
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+
+#define kMaxEpollEvents 16
+
+/** ********** EventLoop ********** */
+
+EventLoop::EventLoop() : _epoll_fd(epoll_create1(EPOLL_CLOEXEC)) {
+  PCHECK(_epoll_fd >= 0) << "Failed to create epoll instance";
+}
+
+EventLoop::~EventLoop() { close(_epoll_fd); }
+
+void EventLoop::add(int fd, uint32_t events, Handler handler) {
+  struct epoll_event event = {0};
+  event.events             = events;
+  event.data.fd            = fd;
+  PCHECK(epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0)
+    << "Failed to add fd " << fd << " to epoll";
+  _removed.erase(std::remove(_removed.begin(), _removed.end(), fd),
+                 _removed.end());
+  _handlers[fd] = std::move(handler);
+}
+
+void EventLoop::remove(int fd) {
+  // The fd may already be closed, in which case the kernel dropped it
+  epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+  _removed.push_back(fd);
+}
+
+void EventLoop::run() {
+  struct epoll_event events[kMaxEpollEvents];
+  _running = true;
+  while (_running) {
+    const int n = epoll_wait(_epoll_fd, events, kMaxEpollEvents, -1);
+    if (n < 0) {
+      PLOG_IF(FATAL, errno != EINTR) << "epoll_wait failed";
+      continue;
+    }
+    for (int i = 0; i < n && _running; ++i) {
+      const int fd = events[i].data.fd;
+      if (isRemoved(fd)) {
+        continue;
+      }
+      const auto it = _handlers.find(fd);
+      if (it != _handlers.end()) {
+        it->second(events[i].events);
+      }
+    }
+    for (const int fd : _removed) {
+      _handlers.erase(fd);
+    }
+    _removed.clear();
+  }
+}
+
+bool EventLoop::isRemoved(int fd) const {
+  return std::find(_removed.begin(), _removed.end(), fd) != _removed.end();
+}
+
+/** ********** TickTimer ********** */
+
+TickTimer::TickTimer(std::chrono::milliseconds interval)
+  : _fd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC))
+  , _interval(interval) {
+  PCHECK(_fd >= 0) << "Failed to create timerfd";
+  arm(std::chrono::nanoseconds(0));
+}
+
+TickTimer::~TickTimer() { close(_fd); }
+
+void TickTimer::setInterval(std::chrono::milliseconds interval) {
+  _interval = interval;
+  arm(_interval);
+}
+
+uint64_t TickTimer::consume() {
+  uint64_t expirations = 0;
+  if (read(_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+    return 0;
+  }
+  return expirations;
+}
+
+void TickTimer::arm(std::chrono::nanoseconds first) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  // Never zero, which would disarm the timer
+  const auto start = std::chrono::seconds(now.tv_sec)
+                     + std::chrono::nanoseconds(now.tv_nsec) + first;
+  const auto interval_ns =
+    std::chrono::duration_cast<std::chrono::nanoseconds>(_interval);
+  struct itimerspec spec;
+  spec.it_value.tv_sec     = start.count() / 1000000000;
+  spec.it_value.tv_nsec    = start.count() % 1000000000;
+  spec.it_interval.tv_sec  = interval_ns.count() / 1000000000;
+  spec.it_interval.tv_nsec = interval_ns.count() % 1000000000;
+  PCHECK(timerfd_settime(_fd, TFD_TIMER_ABSTIME, &spec, NULL) == 0)
+    << "Failed to arm timerfd";
+}
+
+/** ********** SignalFd ********** */
+
+SignalFd::SignalFd(std::initializer_list<int> signals) {
+  sigemptyset(&_mask);
+  for (const int signal : signals) {
+    sigaddset(&_mask, signal);
+  }
+  PCHECK(pthread_sigmask(SIG_BLOCK, &_mask, NULL) == 0)
+    << "Failed to block signals";
+  _fd = signalfd(-1, &_mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  PCHECK(_fd >= 0) << "Failed to create signalfd";
+}
+
+SignalFd::~SignalFd() {
+  close(_fd);
+  pthread_sigmask(SIG_UNBLOCK, &_mask, NULL);
+}
+
+int SignalFd::consume() {
+  struct signalfd_siginfo info;
+  if (read(_fd, &info, sizeof(info)) != sizeof(info)) {
+    return 0;
+  }
+  return info.ssi_signo;
+}
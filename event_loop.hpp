@@ -0,0 +1,80 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <unordered_map>
+#include <vector>
+
+#include <signal.h>
+#include <stdint.h>
+
+// Single threaded epoll dispatcher, every fd the daemon waits on is
+// registered here so the process only wakes when there is work to do
+class EventLoop {
+ public:
+  using Handler = std::function<void(uint32_t events)>;
+
+  EventLoop();
+  EventLoop(const EventLoop &) = delete;
+  ~EventLoop();
+
+  void add(int fd, uint32_t events, Handler handler);
+  // Safe to call from within a handler, including the fd's own handler
+  void remove(int fd);
+  // Dispatches events until stop() is called
+  void run();
+  void stop() { _running = false; }
+
+ private:
+  bool isRemoved(int fd) const;
+
+  int                               _epoll_fd;
+  bool                              _running{false};
+  std::unordered_map<int, Handler>  _handlers;
+  std::vector<int>                  _removed;  // Erased after each dispatch
+};
+
+// Periodic CLOCK_MONOTONIC timerfd. Expirations are scheduled by the kernel on
+// an absolute grid, so time spent handling a tick does not shift the next one.
+class TickTimer {
+ public:
+  // First tick fires immediately
+  explicit TickTimer(std::chrono::milliseconds interval);
+  TickTimer(const TickTimer &) = delete;
+  ~TickTimer();
+
+  int                       fd() const { return _fd; }
+  std::chrono::milliseconds interval() const { return _interval; }
+  // Re-arms the timer, next tick fires one new interval from now
+  void setInterval(std::chrono::milliseconds interval);
+  // Reads the expiration count, more than 1 means ticks were missed
+  uint64_t consume();
+
+ private:
+  void arm(std::chrono::nanoseconds first);
+
+  int                       _fd;
+  std::chrono::milliseconds _interval;
+};
+
+// Blocks the given signals for the whole process and delivers them through
+// a signalfd instead. Must be created before any other thread is spawned so
+// the mask is inherited.
+class SignalFd {
+ public:
+  explicit SignalFd(std::initializer_list<int> signals);
+  SignalFd(const SignalFd &) = delete;
+  ~SignalFd();
+
+  int fd() const { return _fd; }
+  // Returns the number of the pending signal, or 0 if there is none
+  int consume();
+
+ private:
+  int      _fd;
+  sigset_t _mask;
+};
+
+#endif  // EVENT_LOOP_H
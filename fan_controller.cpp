@@ -0,0 +1,96 @@
+#include "fan_controller.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <glog/logging.h>
+
+uint32_t quantize_duty(double duty) {
+  const uint32_t rounded = static_cast<uint32_t>(std::lround(duty / 5.0)) * 5;
+  return std::max<uint32_t>(kMinDuty, std::min<uint32_t>(kMaxDuty, rounded));
+}
+
+uint32_t next_speed(const CompiledProfile &profile,
+                    const uint32_t         current_temp) {
+  return profile.lookup(current_temp);
+}
+
+/** ********** CurveController ********** */
+
+DutyCycle CurveController::update(uint32_t                temp,
+                                  double                  dt,
+                                  const leviathan_config &config) {
+  return follow({next_speed(config.fan_profile_, temp),
+                 next_speed(config.pump_profile_, temp)},
+                dt);
+}
+
+DutyCycle CurveController::follow(DutyCycle next, double dt) {
+  // Step down: If we are decreasing fan/pump speed, do it slowly
+  if (next.fan < _last.fan) {
+    next.fan = _last.fan - 5;
+  }
+  if (next.pump < _last.pump) {
+    next.pump = _last.pump - 5;
+  }
+  _last = next;
+  return next;
+}
+
+/** ********** PidController ********** */
+
+double PidController::Loop::update(const PidGains &gains,
+                                   double          error,
+                                   double          derivative,
+                                   double          dt,
+                                   double          max_rate) {
+  const double proportional = gains.kp * error;
+  const double damping      = gains.kd * derivative;
+  // Conditional integration: don't wind up further while pinned at a limit
+  const double candidate = integral + gains.ki * error * dt;
+  const double unclamped = kMinDuty + proportional + candidate + damping;
+  if ((unclamped < kMaxDuty || error < 0)
+      && (unclamped > kMinDuty || error > 0)) {
+    integral = candidate;
+  }
+  double target = kMinDuty + proportional + integral + damping;
+  target        = std::max<double>(kMinDuty, std::min<double>(kMaxDuty, target));
+  // Rate limit to avoid audible jumps
+  const double max_step = max_rate * dt;
+  output += std::max(-max_step, std::min(max_step, target - output));
+  return output;
+}
+
+DutyCycle PidController::update(uint32_t                temp,
+                                double                  dt,
+                                const leviathan_config &config) {
+  if (temp > kMaxPlausibleTemp) {
+    // Blind, run flat out until the sensor recovers
+    _fan.output = _pump.output = kMaxDuty;
+    return DutyCycle{kMaxDuty, kMaxDuty};
+  }
+  const double current = temp;
+  // Derivative on measurement, a setpoint change doesn't kick the output
+  const double derivative =
+    (_seeded && dt > 0.0) ? (current - _last_temp) / dt : 0.0;
+  const double error = current - config.pid_setpoint_;
+  _last_temp         = current;
+  _seeded            = true;
+
+  const double fan = _fan.update(config.fan_pid_, error, derivative, dt,
+                                 config.pid_max_rate_);
+  const double pump = _pump.update(config.pump_pid_, error, derivative, dt,
+                                   config.pid_max_rate_);
+  VLOG(2) << "PID error " << error << "C, fan output " << fan
+          << ", pump output " << pump;
+  return DutyCycle{quantize_duty(fan), quantize_duty(pump)};
+}
+
+std::unique_ptr<FanController> make_fan_controller(ControllerType type) {
+  switch (type) {
+  case ControllerType::PID:
+    return std::make_unique<PidController>();
+  case ControllerType::CURVE:
+  default:
+    return std::make_unique<CurveController>();
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef FAN_CONTROLLER_H
+#define FAN_CONTROLLER_H
+
+#include <cstdint>
+#include <memory>
+
+#include "leviathan_config.hpp"
+
+// Duty cycle percentages sent to the Kraken, multiples of 5 in [30, 100]
+struct DutyCycle {
+  uint32_t fan;
+  uint32_t pump;
+};
+
+// Turns the control temperature into fan/pump duty cycles every tick
+class FanController {
+ public:
+  virtual ~FanController() = default;
+
+  // dt is the time in seconds since the previous update
+  virtual DutyCycle update(uint32_t                temp,
+                           double                  dt,
+                           const leviathan_config &config) = 0;
+  // Takes a duty cycle picked outside the controller, such as the highest of
+  // the fusion source curves. Returned as is unless overridden.
+  virtual DutyCycle follow(DutyCycle target, double dt) { return target; }
+};
+
+uint32_t next_speed(const CompiledProfile &profile,
+                    const uint32_t         current_temp);
+
+// Follows fan_profile/pump_profile, stepping down by 5% per tick at most
+class CurveController : public FanController {
+ public:
+  DutyCycle update(uint32_t                temp,
+                   double                  dt,
+                   const leviathan_config &config) override;
+  DutyCycle follow(DutyCycle target, double dt) override;
+
+ private:
+  DutyCycle _last{0, 0};  // Take first computed value as is
+};
+
+// Holds the control temperature at pid_setpoint_ with independent fan and
+// pump loops. The integral only accumulates while its output isn't saturated
+// (anti-windup) and the output slews by at most pid_max_rate_ percent/second.
+class PidController : public FanController {
+ public:
+  DutyCycle update(uint32_t                temp,
+                   double                  dt,
+                   const leviathan_config &config) override;
+
+ private:
+  struct Loop {
+    double integral{0.0};
+    double output{kMinDuty};
+    double update(const PidGains &gains,
+                  double          error,
+                  double          derivative,
+                  double          dt,
+                  double          max_rate);
+  };
+
+  Loop   _fan;
+  Loop   _pump;
+  double _last_temp{0.0};
+  bool   _seeded{false};
+};
+
+std::unique_ptr<FanController> make_fan_controller(ControllerType type);
+
+#endif  // FAN_CONTROLLER_H
@@ -0,0 +1,121 @@
+#include "fast_start.hpp"
+#include "leviathan_config.hpp"
+
+#include <glog/logging.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// One line: bus, dot separated ports, fan duty, pump duty, e.g. "3 1.4 45 60"
+std::optional<fast_start_cache> read_fast_start_cache(const char *const path) {
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    return std::nullopt;
+  }
+  fast_start_cache cache = {0};
+  unsigned         bus;
+  char             ports[32];
+  const bool       parsed = fscanf(file, "%u %31s %u %u", &bus, ports,
+                                   &cache.fan_duty, &cache.pump_duty)
+                      == 4;
+  fclose(file);
+  if (!parsed || bus > 255) {
+    LOG(WARNING) << "Ignoring malformed fast start cache " << path;
+    return std::nullopt;
+  }
+  cache.bus = bus;
+  for (char *save, *port = strtok_r(ports, ".", &save); port != NULL;
+       port = strtok_r(NULL, ".", &save)) {
+    if (cache.num_ports == kMaxPortPath) {
+      return std::nullopt;
+    }
+    cache.ports[cache.num_ports++] = atoi(port);
+  }
+  // Same constraints KrakenDriver enforces, a bad value would be fatal there
+  for (const uint32_t duty : {cache.fan_duty, cache.pump_duty}) {
+    if (duty < kMinDuty || duty > kMaxDuty || duty % 5 != 0) {
+      LOG(WARNING) << "Ignoring fast start cache with invalid duty " << duty;
+      return std::nullopt;
+    }
+  }
+  return cache;
+}
+
+void write_fast_start_cache(const char *const       path,
+                            const fast_start_cache &cache) {
+  std::string ports;
+  for (int i = 0; i < cache.num_ports; ++i) {
+    ports += (i == 0 ? "" : ".") + std::to_string(cache.ports[i]);
+  }
+  const std::string tmp_path = std::string(path) + ".tmp";
+  const auto        slash    = tmp_path.find_last_of('/');
+  if (slash != std::string::npos && slash > 0) {
+    // Parent is usually /var/lib/leviathan, created on first run
+    mkdir(tmp_path.substr(0, slash).c_str(), 0755);
+  }
+  FILE *file = fopen(tmp_path.c_str(), "w");
+  if (file == NULL) {
+    PLOG(WARNING) << "Failed to write fast start cache " << tmp_path;
+    return;
+  }
+  fprintf(file, "%u %s %u %u\n", cache.bus, ports.c_str(), cache.fan_duty,
+          cache.pump_duty);
+  if (fclose(file) != 0 || rename(tmp_path.c_str(), path) != 0) {
+    PLOG(WARNING) << "Failed to write fast start cache " << path;
+  }
+}
+
+bool usb_port_path(libusb_device *device, fast_start_cache &cache) {
+  const int n = libusb_get_port_numbers(device, cache.ports, kMaxPortPath);
+  if (n <= 0) {
+    return false;
+  }
+  cache.bus       = libusb_get_bus_number(device);
+  cache.num_ports = n;
+  return true;
+}
+
+libusb_device *find_cached_device(libusb_device *const * devices,
+                                  size_t                  num_devices,
+                                  const fast_start_cache &cache) {
+  for (size_t i = 0; i < num_devices; ++i) {
+    fast_start_cache path = {0};
+    if (usb_port_path(devices[i], path) && path.bus == cache.bus
+        && path.num_ports == cache.num_ports
+        && memcmp(path.ports, cache.ports, path.num_ports) == 0) {
+      return devices[i];
+    }
+  }
+  return nullptr;
+}
+
+std::chrono::duration<double> process_uptime() {
+  // Field 22 of /proc/self/stat is the start time in clock ticks since boot,
+  // the command name before it may contain spaces
+  char  stat[1024];
+  FILE *file = fopen("/proc/self/stat", "r");
+  if (file == NULL) {
+    return std::chrono::duration<double>(0);
+  }
+  const size_t length = fread(stat, 1, sizeof(stat) - 1, file);
+  fclose(file);
+  stat[length]              = '\0';
+  const char *       fields = strrchr(stat, ')');
+  unsigned long long start  = 0;
+  if (fields == NULL
+      || sscanf(fields + 2,
+                "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d "
+                "%*d %*d %*d %*d %llu",
+                &start)
+           != 1) {
+    return std::chrono::duration<double>(0);
+  }
+  struct timespec now;
+  clock_gettime(CLOCK_BOOTTIME, &now);
+  return std::chrono::duration<double>(
+    now.tv_sec + now.tv_nsec / 1e9
+    - static_cast<double>(start) / sysconf(_SC_CLK_TCK));
+}
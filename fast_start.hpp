@@ -0,0 +1,38 @@
+#ifndef FAST_START_H
+#define FAST_START_H
+
+#include <libusb-1.0/libusb.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#define kMaxPortPath 7  // USB 3.0 limit
+
+// Remembered from the previous run so the next start can go straight to the
+// cooler and command a duty cycle before config and sensors are ready
+struct fast_start_cache {
+  uint8_t  bus;
+  uint8_t  ports[kMaxPortPath];
+  int      num_ports;
+  uint32_t fan_duty;
+  uint32_t pump_duty;
+};
+
+// Returns nullopt if the file is missing or doesn't hold a usable cache
+std::optional<fast_start_cache> read_fast_start_cache(const char *const path);
+// Replaced atomically, failures are only logged
+void write_fast_start_cache(const char *const       path,
+                            const fast_start_cache &cache);
+
+// Fills bus and port path of the device, false if libusb can't tell
+bool usb_port_path(libusb_device *device, fast_start_cache &cache);
+// The device at the cached bus and port path, or null
+libusb_device *find_cached_device(libusb_device *const * devices,
+                                  size_t                  num_devices,
+                                  const fast_start_cache &cache);
+
+// Time since the process was started, as recorded by the kernel
+std::chrono::duration<double> process_uptime();
+
+#endif  // FAST_START_H
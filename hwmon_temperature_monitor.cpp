@@ -0,0 +1,141 @@
+#include "hwmon_temperature_monitor.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <glog/logging.h>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// hwmon chip names of CPU temperature drivers, in order of preference
+const char *const kCpuHwmonChips[] = {"coretemp", "k10temp", "zenpower",
+                                      "cpu_thermal"};
+
+std::string read_hwmon_name(const std::string &dir) {
+  std::ifstream name_file(dir + "/name");
+  std::string   name;
+  std::getline(name_file, name);
+  return name;
+}
+
+// Returns temp*_input files of dir as (index, path), sorted by index
+std::vector<std::pair<int, std::string>> list_temp_inputs(
+  const std::string &dir) {
+  std::vector<std::pair<int, std::string>> inputs;
+  DIR *const                               d = opendir(dir.c_str());
+  if (d == NULL) {
+    return inputs;
+  }
+  while (const struct dirent *entry = readdir(d)) {
+    int  index;
+    char suffix[8];
+    if (sscanf(entry->d_name, "temp%d_%7s", &index, suffix) == 2
+        && strcmp(suffix, "input") == 0) {
+      inputs.emplace_back(index, dir + "/" + entry->d_name);
+    }
+  }
+  closedir(d);
+  std::sort(inputs.begin(), inputs.end());
+  return inputs;
+}
+
+std::vector<std::pair<std::string, std::string>> list_hwmon_chips(
+  const char *const root) {
+  std::vector<std::pair<std::string, std::string>> chips;
+  DIR *const                                       d = opendir(root);
+  if (d == NULL) {
+    throw std::runtime_error(std::string("Unable to open ") + root);
+  }
+  while (const struct dirent *entry = readdir(d)) {
+    if (strncmp(entry->d_name, "hwmon", 5) == 0) {
+      const std::string dir = std::string(root) + "/" + entry->d_name;
+      chips.emplace_back(read_hwmon_name(dir), dir);
+    }
+  }
+  closedir(d);
+  // readdir order is arbitrary, keep the first match of a name stable
+  std::sort(chips.begin(), chips.end());
+  return chips;
+}
+
+int32_t read_hwmon_temperature(int fd) {
+  // sysfs values are millidegrees followed by a newline
+  char          buffer[16];
+  const ssize_t len = pread(fd, buffer, sizeof(buffer), 0);
+  if (len <= 0) {
+    return std::numeric_limits<int>::min();
+  }
+  int32_t millidegrees = 0;
+  for (ssize_t i = 0; i < len && buffer[i] >= '0' && buffer[i] <= '9'; ++i) {
+    millidegrees = millidegrees * 10 + (buffer[i] - '0');
+  }
+  return millidegrees / 1000;
+}
+
+HwmonTemperatureMonitor::HwmonTemperatureMonitor(const char *const root) {
+  // Map every hwmon device under root to its chip name
+  const auto chips = list_hwmon_chips(root);
+  for (const char *const wanted : kCpuHwmonChips) {
+    const auto chip =
+      std::find_if(chips.begin(), chips.end(),
+                   [wanted](const auto &c) { return c.first == wanted; });
+    if (chip == chips.end()) {
+      continue;
+    }
+    // Older kernels expose the inputs on the underlying device instead
+    auto inputs = list_temp_inputs(chip->second);
+    if (inputs.empty()) {
+      inputs = list_temp_inputs(chip->second + "/device");
+    }
+    for (const auto &input : inputs) {
+      const int fd = open(input.second.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) {
+        PLOG(WARNING) << "Unable to open " << input.second;
+        continue;
+      }
+      _fds.push_back(fd);
+    }
+    if (!_fds.empty()) {
+      _chip = chip->first;
+      LOG(INFO) << "Using hwmon chip " << _chip << " at " << chip->second
+                << " with " << _fds.size() << " temperature inputs";
+      return;
+    }
+  }
+  throw std::runtime_error("No supported CPU hwmon chip detected");
+}
+
+HwmonTemperatureMonitor::~HwmonTemperatureMonitor() {
+  for (const int fd : _fds) {
+    close(fd);
+  }
+}
+
+uint32_t HwmonTemperatureMonitor::getCoreIdTemperature(uint8_t core_id) const {
+  // Chips like cpu_thermal, or k10temp on APUs, only expose the package input.
+  // On bad input, normalize instead of returning -1.
+  return coreCount() == 0
+           ? readInput(0)
+           : readInput(std::min<size_t>(core_id, coreCount() - 1) + 1);
+}
+
+size_t HwmonTemperatureMonitor::sampleCoreTemperatures(int32_t *out,
+                                                      size_t   capacity) const {
+  const size_t n = std::min(coreCount(), capacity);
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = readInput(i + 1);
+  }
+  return n;
+}
+
+uint32_t HwmonTemperatureMonitor::readInput(size_t index) const {
+  const int32_t temp = read_hwmon_temperature(_fds[index]);
+  LOG_IF(WARNING, temp == std::numeric_limits<int>::min())
+    << "Failure reading hwmon temp" << index + 1 << "_input";
+  return temp;
+}
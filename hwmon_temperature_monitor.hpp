@@ -0,0 +1,50 @@
+#ifndef HWMON_TEMPERATURE_MONITOR_H
+#define HWMON_TEMPERATURE_MONITOR_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "temperature_monitor.hpp"
+
+// (chip name, directory) of every hwmon device under root, sorted by name.
+// Throws std::runtime_error if root can't be read.
+std::vector<std::pair<std::string, std::string>> list_hwmon_chips(
+  const char *const root);
+// Whole degrees from an open temp*_input file, a pread into a stack buffer.
+// Returns std::numeric_limits<int>::min() on failure.
+int32_t read_hwmon_temperature(int fd);
+
+// Reads the CPU temperature straight from the kernel's hwmon sysfs files. The
+// CPU chip (coretemp, k10temp, ...) is detected once on construction and its
+// temp*_input files are kept open, so a sample is a single pread into a stack
+// buffer with no allocation and no library calls.
+class HwmonTemperatureMonitor : public TemperatureMonitor {
+ public:
+  // Throws std::runtime_error if no supported CPU chip is found. Chips with only
+  // the package input are accepted, they have no cores to sample.
+  explicit HwmonTemperatureMonitor(const char *const root = kDefaultHwmonDir);
+  HwmonTemperatureMonitor(const HwmonTemperatureMonitor &) = delete;
+  ~HwmonTemperatureMonitor();
+
+  // temp1 is "Package id 0" on coretemp and "Tctl" on k10temp
+  uint32_t getPackageIdTemperature() const override { return readInput(0); }
+  uint32_t getCoreIdTemperature(uint8_t core_id) const override;
+  size_t   coreCount() const override {
+    return _fds.empty() ? 0 : _fds.size() - 1;
+  }
+  size_t   sampleCoreTemperatures(int32_t *out,
+                                  size_t   capacity) const override;
+
+  const std::string &chipName() const { return _chip; }
+
+ private:
+  uint32_t readInput(size_t index) const;
+
+  std::string      _chip;
+  std::vector<int> _fds;  // Sorted by temp index, _fds[0] is the package
+};
+
+#endif  // HWMON_TEMPERATURE_MONITOR_H
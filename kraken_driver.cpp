@@ -1,62 +1,26 @@
 #include "kraken_driver.hpp"
-#include "usb_descriptor_utils.hpp"
+#include "libusb_transport.hpp"
 
 #include <algorithm>
 #include <glog/logging.h>
+#include <stdexcept>
 #include <string.h>
 
-#define kMainConfigurationIndex 0
-#define kMainConfigurationValue 1
-
-void set_color_arr(const uint32_t c, unsigned char *arr) {
-  arr[0] = (c & 0x00FF0000) >> 16;
-  arr[1] = (c & 0x0000FF00) >> 8;
-  arr[2] = c & 0x000000FF;
-}
-
-// TODO: Make params const
 KrakenDriver::KrakenDriver(libusb_device *kraken_device)
-  : _device(kraken_device)
-  , _desc(get_descriptor(_device))
-  , _config(get_config_descriptor(_device))
-  , _handle(get_handle(_device)) {
-  // Init _color to kDefaultColor, most bytes will never change
-  memcpy(_color, kDefaultColor, 19);
-
-  // Grab endpoints via libusb
-  CHECK(_config->bConfigurationValue == kMainConfigurationValue)
-    << "bConfigurationValue must equal: " << kMainConfigurationValue;
-  const int set_configuration_result =
-    libusb_set_configuration(_handle, kMainConfigurationValue);
-  CHECK(set_configuration_result == 0)
-    << "Error when setting kraken usb configuration, got: "
-    << libusb_error_name(set_configuration_result);
-  const libusb_interface_descriptor main_interface =
-    get_main_usb_interface(_config);
-  const libusb_endpoint_descriptor *endpoints = main_interface.endpoint;
-  CHECK(main_interface.bNumEndpoints == 2) << "Expecting only 2 endpoints";
-  set_endpoints(endpoints, _endpointIn, _endpointOut);
+  : KrakenDriver(std::make_unique<LibusbTransport>(kraken_device)) {}
 
+KrakenDriver::KrakenDriver(std::unique_ptr<KrakenTransport> transport)
+  : _transport(std::move(transport)) {
   // Send initialization control message, at startup and never again
-  sendControlTransfer(KRAKEN_INIT);
-}
-
-KrakenDriver::~KrakenDriver() {
-  if (_config) {
-    libusb_free_config_descriptor(_config);
-  }
-  if (_handle) {
-    libusb_close(_handle);
+  if (!sendControlTransfer(KRAKEN_INIT)) {
+    throw std::runtime_error("Failed to send initialization message");
   }
+  _serial = _transport->serialNumber();
 }
 
-/** ********** Public interface ********** */
+KrakenDriver::~KrakenDriver() {}
 
-std::string KrakenDriver::getSerialNumber() const {
-  CHECK(_desc.iSerialNumber)
-    << "Expecting Kraken to have string descriptor for device serial number";
-  return get_serial_number(_desc, _handle);
-}
+/** ********** Public interface ********** */
 
 void KrakenDriver::setFanSpeed(unsigned char fan_speed) {
   CHECK(fan_speed <= 100 && fan_speed >= 30 && fan_speed % 5 == 0)
@@ -72,55 +36,142 @@ void KrakenDriver::setPumpSpeed(unsigned char pump_speed) {
   _pump_speed[1] = pump_speed;
 }
 
-void KrakenDriver::setColor(uint32_t c) {
-  unsigned char color[3];
-  set_color_arr(c, color);
-  _color[1] = color[0];
-  _color[2] = color[1];
-  _color[3] = color[2];
+void KrakenDriver::setColor(const ColorPacket &packet) {
+  if (packet != _color) {
+    _color         = packet;
+    _color_pending = true;
+  }
 }
 
-std::map<std::string, uint32_t> KrakenDriver::sendColorUpdate() {
-  sendControlTransfer(KRAKEN_BEGIN);
-  sendBulkRawData(_color, 19);
-  return receiveStatus();
+// The status frame is read even after a failed write, the device answers
+// every BEGIN with one. The update only counts if every transfer went through.
+KrakenStatus KrakenDriver::sendColorUpdate() {
+  bool sent = sendControlTransfer(KRAKEN_BEGIN);
+  sent &= sendBulkRawData(_color.data(), _color.size());
+  const KrakenStatus status = receiveStatus();
+  if (!sent || !status.valid) {
+    return KrakenStatus{};
+  }
+  _color_pending = false;
+  return status;
 }
 
-std::map<std::string, uint32_t> KrakenDriver::sendSpeedUpdate() {
-  sendControlTransfer(KRAKEN_BEGIN);
-  sendBulkRawData(_pump_speed, 2);
-  sendBulkRawData(_fan_speed, 2);
-  return receiveStatus();
+KrakenStatus KrakenDriver::sendSpeedUpdate() {
+  bool sent = sendControlTransfer(KRAKEN_BEGIN);
+  sent &= sendBulkRawData(_pump_speed, 2);
+  sent &= sendBulkRawData(_fan_speed, 2);
+  const KrakenStatus status = receiveStatus();
+  return sent ? status : KrakenStatus{};
+}
+
+bool KrakenDriver::queueUpdate() {
+  TransferBatch &batch = _transport->batch();
+  if (batch.inFlight()) {
+    return false;
+  }
+  batch.clear();
+  _color_queued = _color_pending;
+  if (_color_queued) {
+    _queued_color = _color;
+    batch.addControl(KRAKEN_BEGIN);
+    batch.addBulkOut(_color.data(), _color.size());
+    batch.addBulkIn(32);
+  }
+  batch.addControl(KRAKEN_BEGIN);
+  batch.addBulkOut(_pump_speed, 2);
+  batch.addBulkOut(_fan_speed, 2);
+  batch.addBulkIn(32);
+  if (_recorder) {
+    // As queued, the status frame is recorded once the batch completes
+    if (_color_queued) {
+      recordControl(KRAKEN_BEGIN);
+      _recorder->record(SessionRecord::USB_OUT, _record_device, _color.data(),
+                        _color.size());
+    }
+    recordControl(KRAKEN_BEGIN);
+    _recorder->record(SessionRecord::USB_OUT, _record_device, _pump_speed, 2);
+    _recorder->record(SessionRecord::USB_OUT, _record_device, _fan_speed, 2);
+  }
+  return batch.submit();
+}
+
+bool KrakenDriver::pollUpdate(KrakenStatus &status) {
+  TransferBatch &batch = _transport->batch();
+  switch (batch.poll()) {
+  case TransferBatch::State::COMPLETED:
+    if (_recorder) {
+      _recorder->record(SessionRecord::USB_IN, _record_device,
+                        batch.lastRead(), 32);
+    }
+    status = parseStatus(batch.lastRead());
+    // setColor may have replaced the packet while this batch was on the bus
+    _color_pending &= !(_color_queued && _queued_color == _color);
+    return true;
+  case TransferBatch::State::FAILED:
+    LOG(WARNING) << "Async update batch failed";
+    status = KrakenStatus{};
+    return true;
+  default:
+    return false;
+  }
+}
+
+void KrakenDriver::recordTo(SessionRecorder *recorder, uint8_t device) {
+  if (recorder && (recorder != _recorder || device != _record_device)) {
+    recorder->record(SessionRecord::DEVICE, device, _serial.data(),
+                     _serial.size());
+  }
+  _recorder      = recorder;
+  _record_device = device;
+}
+
+KrakenStatus KrakenDriver::parseStatus(const unsigned char *status) {
+  KrakenStatus results;
+  // TODO: Kraken is returning 0 for status[0] and status[1]
+  // Maybe a firmware update is needed...
+  results.fan_rpm     = 256 * status[0] + status[1];
+  results.pump_rpm    = 256 * status[8] + status[9];
+  results.liquid_temp = status[10];
+  results.valid       = true;
+  return results;
 }
 
 /** ********** Private interface ********** */
 
+void KrakenDriver::recordControl(uint16_t wValue) {
+  _recorder->record(SessionRecord::USB_CONTROL, _record_device, &wValue,
+                    sizeof(wValue));
+}
+
 bool KrakenDriver::sendControlTransfer(uint16_t wValue) {
-  return transfer_control_value(_handle, wValue);
+  if (_recorder) {
+    recordControl(wValue);
+  }
+  return _transport->control(wValue);
 }
 
-bool KrakenDriver::sendBulkRawData(unsigned char *data, const size_t length) {
-  return transfer_bulk_raw_data(_handle, _endpointOut.bEndpointAddress, data,
-                                length);
+bool KrakenDriver::sendBulkRawData(const unsigned char *data,
+                                   const size_t         length) {
+  if (_recorder) {
+    _recorder->record(SessionRecord::USB_OUT, _record_device, data, length);
+  }
+  return _transport->bulkOut(data, length);
 }
 
 bool KrakenDriver::readBulkRawData(unsigned char *results,
                                    const size_t   length) {
-  return transfer_bulk_raw_data(_handle, _endpointIn.bEndpointAddress, results,
-                                length);
+  const bool read = _transport->bulkIn(results, length);
+  if (read && _recorder) {
+    _recorder->record(SessionRecord::USB_IN, _record_device, results, length);
+  }
+  return read;
 }
 
-std::map<std::string, uint32_t> KrakenDriver::receiveStatus() {
-  unsigned char                   status[32];
-  std::map<std::string, uint32_t> results;
+KrakenStatus KrakenDriver::receiveStatus() {
+  unsigned char status[32];
   if (readBulkRawData(status, 32) == false) {
     LOG(WARNING) << "Call to readBulkRawData - 32 bytes, failed";
-    return results;
+    return KrakenStatus{};
   }
-  // TODO: Kraken is returning 0 for status[0] and status[1]
-  // Maybe a firmware update is needed...
-  results["fan_speed"]          = 256 * status[0] + status[1];
-  results["pump_speed"]         = 256 * status[8] + status[9];
-  results["liquid_temperature"] = status[10];
-  return results;
+  return parseStatus(status);
 }
@@ -2,51 +2,93 @@
 #define KRAKEN_DRIVER_H
 
 #include <libusb-1.0/libusb.h>
-#include <map>
+#include <chrono>
+#include <memory>
 #include <string>
 
+#include "color_packet.hpp"
 #include "constants.h"
+#include "kraken_transport.hpp"
+#include "session_trace.hpp"
 
-// Using this class will query usb bus for the kraken device details
-// and set the proper usb configuration to kMainConfigurationIndex
+// One decoded status frame. valid is false if any transfer of the update
+// failed, the readings are 0 then.
+struct KrakenStatus {
+  uint32_t fan_rpm;
+  uint32_t pump_rpm;
+  uint32_t liquid_temp;  // C
+  bool     valid;
+};
+
+// Speaks the Kraken protocol (INIT/BEGIN control values, color, fan and pump
+// packets, 32 byte status frames) over a KrakenTransport
 class KrakenDriver {
  public:
-  // TODO: Maybe this makes more sense to be a singleton?
   // Creating an instance of this object claims ownership of the usb
-  // endpoint, new instances fail to initalize on construction
-  KrakenDriver(libusb_device *kraken);
+  // endpoint of that device, a second instance for the same device fails to
+  // initialize on construction. Any number of devices can be driven at once.
+  // Throws std::runtime_error if the device is gone or can't be set up.
+  explicit KrakenDriver(libusb_device *kraken);
+  // Drives any other transport, e.g. a SimulatedKraken. Also throws if the
+  // device doesn't accept the initialization message.
+  explicit KrakenDriver(std::unique_ptr<KrakenTransport> transport);
   KrakenDriver(const KrakenDriver &) = delete;
   KrakenDriver(const KrakenDriver &&) = delete;
   virtual ~KrakenDriver();
 
   void setFanSpeed(unsigned char);
   void setPumpSpeed(unsigned char);
-  void setColor(uint32_t);
-  std::map<std::string, uint32_t> sendColorUpdate();
-  std::map<std::string, uint32_t> sendSpeedUpdate();
+  // The device keeps running the effect on its own, the packet is only sent
+  // again once it differs from the last one the device accepted
+  void setColor(const ColorPacket &packet);
+  bool colorPending() const { return _color_pending; }
+  KrakenStatus sendColorUpdate();
+  KrakenStatus sendSpeedUpdate();
+
+  // Non-blocking alternative to sendColorUpdate + sendSpeedUpdate. Queues the
+  // speed sequence, preceded by the color sequence if it is pending, as one
+  // batch. Returns false if the previous batch is still on the bus and
+  // nothing was queued.
+  bool queueUpdate();
+  // Returns true once the queued batch has finished, status is filled with
+  // the final status or marked invalid if any transfer in the batch failed.
+  bool pollUpdate(KrakenStatus &status);
+  // Time the last completed batch spent on the bus
+  std::chrono::steady_clock::duration lastRoundTrip() const {
+    return _transport->batch().roundTrip();
+  }
+
+  // Read once on construction, the device is never asked again
+  const std::string &getSerialNumber() const { return _serial; }
+
+  // Records every frame exchanged from now on as the given device index,
+  // starting with its serial number. Null stops recording. Must not be
+  // called while another thread uses the driver.
+  void recordTo(SessionRecorder *recorder, uint8_t device);
 
-  std::string getSerialNumber() const;
+  // Decodes a 32 byte status frame into rpms and liquid temperature
+  static KrakenStatus parseStatus(const unsigned char *status);
 
  private:
+  void recordControl(uint16_t wValue);
   bool sendControlTransfer(uint16_t wValue);
-  bool sendBulkRawData(unsigned char *data, const size_t length);
+  bool sendBulkRawData(const unsigned char *data, const size_t length);
   bool readBulkRawData(unsigned char *results, const size_t length);
 
-  std::map<std::string, uint32_t> receiveStatus();
+  KrakenStatus receiveStatus();
 
-  unsigned char _color[19];
+  ColorPacket   _color;
+  bool          _color_pending = true;  // Until the device accepted _color
+  bool          _color_queued  = false;  // Part of the batch on the bus
+  ColorPacket   _queued_color;           // As sent by that batch
   unsigned char _fan_speed[2]{KRAKEN_FAN_CODE, 30};
   unsigned char _pump_speed[2]{KRAKEN_PUMP_CODE, 30};
 
  private:
-  libusb_device *const            _device;  // Unowned
-  const libusb_device_descriptor  _desc;
-  libusb_config_descriptor *const _config;
-  libusb_device_handle *const     _handle;
-
-  // TODO: Make const
-  libusb_endpoint_descriptor _endpointOut;
-  libusb_endpoint_descriptor _endpointIn;
+  const std::unique_ptr<KrakenTransport> _transport;
+  std::string                            _serial;
+  SessionRecorder *                      _recorder = nullptr;
+  uint8_t                                _record_device = 0;
 };
 
 #endif  // KRAKEN_DRIVER_H
@@ -0,0 +1,53 @@
+#ifndef KRAKEN_TRANSPORT_H
+#define KRAKEN_TRANSPORT_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Non-blocking sequence of control writes, bulk writes and bulk reads, run in
+// order. Only one batch is in flight at a time.
+class TransferBatch {
+ public:
+  enum class State { IDLE, IN_FLIGHT, COMPLETED, FAILED };
+
+  virtual ~TransferBatch() = default;
+
+  // Building a batch, only permitted while no batch is in flight
+  virtual void clear()                                                = 0;
+  virtual void addControl(uint16_t value)                             = 0;
+  virtual void addBulkOut(const unsigned char *data, const size_t length) = 0;
+  virtual void addBulkIn(const size_t length)                         = 0;
+
+  // Starts the queued batch, returns false if one is already in flight
+  virtual bool submit() = 0;
+  // Returns COMPLETED/FAILED once, then the batch goes back to IDLE
+  virtual State poll() = 0;
+  // True between submit() and the transfers finishing
+  virtual bool inFlight() const = 0;
+  // Data received by the last bulk read of the most recent completed batch
+  virtual const unsigned char *lastRead() const = 0;
+  // Submission to final completion of the most recent completed batch
+  virtual std::chrono::steady_clock::duration roundTrip() const = 0;
+};
+
+// Moves Kraken protocol messages to and from one device. KrakenDriver only
+// speaks the protocol through this, so the device behind it can be the real
+// cooler over libusb or a simulation.
+class KrakenTransport {
+ public:
+  virtual ~KrakenTransport() = default;
+
+  // Throws std::runtime_error if it can't be read
+  virtual std::string serialNumber() = 0;
+
+  // Blocking transfers, return false on failure
+  virtual bool control(uint16_t value)                                = 0;
+  virtual bool bulkOut(const unsigned char *data, const size_t length) = 0;
+  virtual bool bulkIn(unsigned char *data, const size_t length)       = 0;
+
+  virtual TransferBatch &batch() = 0;
+};
+
+#endif  // KRAKEN_TRANSPORT_H
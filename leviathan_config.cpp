@@ -1,50 +1,436 @@
 #include "leviathan_config.hpp"
 #include <exception>
+#include <type_traits>
 #include <algorithm>
 #include <glog/logging.h>
 #include <yaml-cpp/yaml.h>
 
-// TODO: Cleaner normalization
+// Slopes are held in 16.16 fixed point, rounded up so that the result floors
+// to exactly the same value as the true rational line for any x within the
+// table (error stays below 1/dx for |x - a.x| * dx < 2^16)
 LineFunction slope_function(const Point &a, const Point &b) {
-  const auto ys = b.y - a.y;
-  const auto xs = b.x - a.x;
+  const int64_t ys = b.y - a.y;
+  const int64_t xs = b.x - a.x;
   if (xs == 0) {
     throw std::runtime_error("Infinite slope detected");
   }
-  const auto slope = ys / xs;
-  const auto bFac  = b.y - (slope * b.x);
-  return [slope, bFac](int32_t x) {
-    const auto newY = (slope * x) + bFac;
+  const int64_t scaled = ys * 65536;
+  const int64_t slope =
+    (scaled > 0) == (xs > 0) ? (scaled + xs - (xs > 0 ? 1 : -1)) / xs
+                             : scaled / xs;
+  return [a, slope](int32_t x) {
+    const int64_t fixedY = (static_cast<int64_t>(a.y) << 16) + (x - a.x) * slope;
+    const int32_t newY   = static_cast<int32_t>(fixedY >> 16);
     // Normalize to a multiple of 5
     const auto evenDiff = newY % 5;
     return newY - evenDiff;  // hit it on the nose == 0
   };
 }
 
-std::map<int32_t, LineFunction> configure_profile(
-  const YAML::Node &fan_profile) {
-  CHECK(fan_profile.IsSequence()) << "Expecting a sequence of pairs";
+CompiledProfile configure_profile(const YAML::Node &profile) {
+  if (!profile.IsSequence()) {
+    throw std::runtime_error("Expecting a sequence of pairs");
+  }
   const auto point_compare = [](const Point &p, const Point &u) {
-    return p.x > u.x;
+    return p.x < u.x;
   };
-  std::vector<Point> dataPoints { Point(0, 30) };
-  for (const auto &i : fan_profile.as<std::vector<std::vector<uint32_t>>>()) {
-    CHECK(i.size() == 2) << "Expecting array of pairs for fan/pump profile";
-    CHECK(i.back() % 5 == 0) << "Fan/pump profile values must be divisible by 5";
+  std::vector<Point> dataPoints{Point(0, kMinDuty)};
+  for (const auto &i : profile.as<std::vector<std::vector<uint32_t>>>()) {
+    if (i.size() != 2) {
+      throw std::runtime_error("Expecting array of pairs for fan/pump profile");
+    }
+    if (i.back() % 5 != 0) {
+      throw std::runtime_error("Fan/pump profile values must be divisible by 5");
+    }
     dataPoints.emplace_back(i.front(), i.back());
   }
-  dataPoints.emplace_back(100, 100);
-  std::sort(dataPoints.begin(), dataPoints.end(), point_compare);
-  std::map<int32_t, LineFunction> temp_to_slope;
-  for (auto i = 0; i < dataPoints.size() - 1; ++i) {
-    const Point &cur_pt = dataPoints[i];
-    const Point &next_pt = dataPoints[i + 1];
-    temp_to_slope[cur_pt.x] = slope_function(cur_pt, next_pt);
+  dataPoints.emplace_back(100, kMaxDuty);
+  std::stable_sort(dataPoints.begin(), dataPoints.end(), point_compare);
+
+  // Walk the sorted segments once, evaluating each whole degree
+  CompiledProfile compiled;
+  size_t          segment = 0;
+  LineFunction    line    = slope_function(dataPoints[0], dataPoints[1]);
+  for (int32_t t = 0; t < kProfileTableSize; ++t) {
+    while (segment + 2 < dataPoints.size() && t >= dataPoints[segment + 1].x) {
+      ++segment;
+      line = slope_function(dataPoints[segment], dataPoints[segment + 1]);
+    }
+    // Past the last point the curve is flat
+    const int32_t value = line(std::min(t, dataPoints[segment + 1].x));
+    compiled.duty_[t] = std::max(kMinDuty, std::min(kMaxDuty, value));
   }
-  return temp_to_slope;
+  return compiled;
 }
 
-leviathan_config parse_config_file(const char *const path) {
+// Points are [temperature, 0xRRGGBB] pairs, flat before the first point and
+// after the last one
+CompiledGradient configure_gradient(const YAML::Node &gradient) {
+  if (!gradient.IsSequence() || gradient.size() == 0) {
+    throw std::runtime_error("Expecting a non empty sequence of pairs");
+  }
+  std::vector<std::pair<uint32_t, uint32_t>> points;
+  for (const auto &i : gradient.as<std::vector<std::vector<uint32_t>>>()) {
+    if (i.size() != 2) {
+      throw std::runtime_error("Expecting array of pairs for color_gradient");
+    }
+    if (i.back() > 0xFFFFFF) {
+      throw std::runtime_error("color_gradient colors must be 24 bit RGB");
+    }
+    points.emplace_back(i.front(), i.back());
+  }
+  std::stable_sort(points.begin(), points.end(),
+                   [](const auto &a, const auto &b) {
+                     return a.first < b.first;
+                   });
+
+  CompiledGradient compiled;
+  compiled.enabled_ = true;
+  size_t segment    = 0;
+  for (uint32_t t = 0; t < kProfileTableSize; ++t) {
+    while (segment + 1 < points.size() && t >= points[segment + 1].first) {
+      ++segment;
+    }
+    const auto &a = points[segment];
+    if (t <= a.first || segment + 1 == points.size()) {
+      compiled.rgb_[t] = a.second;
+      continue;
+    }
+    const auto &   b     = points[segment + 1];
+    const uint32_t num   = t - a.first;
+    const uint32_t den   = b.first - a.first;
+    uint32_t       color = 0;
+    for (int shift = 16; shift >= 0; shift -= 8) {
+      const int32_t from = (a.second >> shift) & 0xFF;
+      const int32_t to   = (b.second >> shift) & 0xFF;
+      color |= static_cast<uint32_t>(from + (to - from) * (int32_t)num
+                                              / (int32_t)den)
+               << shift;
+    }
+    compiled.rgb_[t] = color;
+  }
+  return compiled;
+}
+
+UsbTransport stringToUsbTransport(const std::string &uts) {
+  if (uts == "sync") {
+    return UsbTransport::SYNC;
+  } else if (uts == "async") {
+    return UsbTransport::ASYNC;
+  } else if (uts == "thread") {
+    return UsbTransport::THREAD;
+  }
+  throw std::runtime_error(
+    "usb_transport must be \"sync\", \"async\" or \"thread\"");
+}
+
+bool parse_interval_mode(const std::string &mode) {
+  if (mode != "fixed" && mode != "adaptive") {
+    throw std::runtime_error("interval_mode must be \"fixed\" or \"adaptive\"");
+  }
+  return mode == "adaptive";
+}
+
+TempSource stringToTempSource(const std::string &tss) {
+  if (tss == "cpu") {
+    return TempSource::CPU;
+  } else if (tss == "liquid") {
+    return TempSource::LIQUID;
+  } else if (tss == "fused") {
+    return TempSource::FUSED;
+  }
+  throw std::runtime_error(
+    "temperature_source must be \"cpu\", \"liquid\" or \"fused\", got: "
+    + tss);
+}
+
+const char *tempSourceToString(TempSource source) {
+  switch (source) {
+  case TempSource::LIQUID:
+    return "liquid";
+  case TempSource::FUSED:
+    return "fused";
+  case TempSource::CPU:
+  default:
+    return "CPU";
+  }
+}
+
+FusionMode stringToFusionMode(const std::string &fms) {
+  if (fms == "weighted") {
+    return FusionMode::WEIGHTED;
+  } else if (fms == "max_curve") {
+    return FusionMode::MAX_CURVE;
+  }
+  throw std::runtime_error(
+    "fusion mode must be \"weighted\" or \"max_curve\"");
+}
+
+// Keyed by name, e.g. gpu: {chip: "amdgpu", input: 1}
+std::vector<hwmon_sensor> parse_sensors(const YAML::Node &node) {
+  std::vector<hwmon_sensor> sensors;
+  for (const auto &entry : node) {
+    hwmon_sensor sensor;
+    sensor.name_ = entry.first.as<std::string>();
+    if (!entry.second["chip"]) {
+      throw std::runtime_error("sensor " + sensor.name_ + " needs a chip");
+    }
+    sensor.chip_ = entry.second["chip"].as<std::string>();
+    if (entry.second["input"]) {
+      sensor.input_ = entry.second["input"].as<uint32_t>();
+    }
+    if (sensor.name_ == "cpu" || sensor.name_ == "liquid") {
+      throw std::runtime_error("sensor name " + sensor.name_ + " is reserved");
+    }
+    for (const auto &other : sensors) {
+      if (other.name_ == sensor.name_) {
+        throw std::runtime_error("duplicate sensor " + sensor.name_);
+      }
+    }
+    sensors.push_back(sensor);
+  }
+  if (sensors.size() > kMaxTempSources - kFirstHwmonSource) {
+    throw std::runtime_error(
+      "at most " + std::to_string(kMaxTempSources - kFirstHwmonSource)
+      + " sensors are supported");
+  }
+  return sensors;
+}
+
+uint32_t temp_source_index(const std::string &             name,
+                           const std::vector<hwmon_sensor> &sensors) {
+  if (name == "cpu") {
+    return kCpuSource;
+  } else if (name == "liquid") {
+    return kLiquidSource;
+  }
+  for (size_t i = 0; i < sensors.size(); ++i) {
+    if (sensors[i].name_ == name) {
+      return kFirstHwmonSource + i;
+    }
+  }
+  throw std::runtime_error("unknown fusion source " + name
+                           + ", expecting cpu, liquid or a sensor name");
+}
+
+// Sources are "cpu", "liquid" or the name of a sensor. Curves default to the
+// fan/pump profile of the config.
+void parse_fusion(const YAML::Node &node, leviathan_config &options) {
+  if (node["mode"]) {
+    options.fusion_mode_ = stringToFusionMode(node["mode"].as<std::string>());
+  }
+  if (!node["sources"]) {
+    return;
+  }
+  options.fusion_sources_.clear();
+  for (const auto &entry : node["sources"]) {
+    fusion_source source;
+    source.index_ =
+      temp_source_index(entry.first.as<std::string>(), options.sensors_);
+    source.fan_profile_  = options.fan_profile_;
+    source.pump_profile_ = options.pump_profile_;
+    if (entry.second["weight"]) {
+      source.weight_ = entry.second["weight"].as<double>();
+    }
+    if (entry.second["fan_profile"]) {
+      source.fan_profile_  = configure_profile(entry.second["fan_profile"]);
+      source.pump_profile_ = source.fan_profile_;
+    }
+    if (entry.second["pump_profile"]) {
+      source.pump_profile_ = configure_profile(entry.second["pump_profile"]);
+    }
+    options.fusion_sources_.push_back(source);
+  }
+}
+
+ControllerType stringToControllerType(const std::string &cts) {
+  if (cts == "curve") {
+    return ControllerType::CURVE;
+  } else if (cts == "pid") {
+    return ControllerType::PID;
+  }
+  throw std::runtime_error("controller must be \"curve\" or \"pid\"");
+}
+
+LightingMode stringToLightingMode(const std::string &lms) {
+  if (lms == "static") {
+    return LightingMode::STATIC;
+  } else if (lms == "alternate") {
+    return LightingMode::ALTERNATE;
+  } else if (lms == "blink") {
+    return LightingMode::BLINK;
+  } else if (lms == "off") {
+    return LightingMode::OFF;
+  }
+  throw std::runtime_error(
+    "lighting_mode must be \"static\", \"alternate\", \"blink\" or \"off\"");
+}
+
+// Lighting keys, accepted at the top level and in device sections
+void parse_lighting(const YAML::Node &node, leviathan_config &options) {
+  if (node["lighting_mode"]) {
+    options.lighting_mode_ =
+      stringToLightingMode(node["lighting_mode"].as<std::string>());
+  }
+  if (node["alternate_color"]) {
+    options.alternate_color_ = node["alternate_color"].as<uint32_t>();
+  }
+  if (node["lighting_interval"]) {
+    options.lighting_interval_ = node["lighting_interval"].as<uint32_t>();
+  }
+  if (node["color_gradient"]) {
+    options.color_gradient_ = configure_gradient(node["color_gradient"]);
+  }
+}
+
+PidGains parse_pid_gains(const YAML::Node &node, const PidGains &defaults) {
+  PidGains gains = defaults;
+  if (node) {
+    gains.kp = node["kp"] ? node["kp"].as<double>() : gains.kp;
+    gains.ki = node["ki"] ? node["ki"].as<double>() : gains.ki;
+    gains.kd = node["kd"] ? node["kd"].as<double>() : gains.kd;
+  }
+  return gains;
+}
+
+simulation_config parse_simulation(const YAML::Node &node) {
+  simulation_config sim;
+  const auto        read = [&node](const char *const key, auto &value) {
+    if (node[key]) {
+      value = node[key].as<std::remove_reference_t<decltype(value)>>();
+    }
+  };
+  read("devices", sim.devices_);
+  read("heat_load", sim.heat_load_);
+  read("idle_load", sim.idle_load_);
+  read("load_period", sim.load_period_);
+  read("ambient", sim.ambient_);
+  read("liquid_capacity", sim.liquid_capacity_);
+  read("cold_plate_resistance", sim.cold_plate_resistance_);
+  read("min_conductance", sim.min_conductance_);
+  read("max_conductance", sim.max_conductance_);
+  read("fan_max_rpm", sim.fan_max_rpm_);
+  read("pump_max_rpm", sim.pump_max_rpm_);
+  read("spin_time_constant", sim.spin_time_constant_);
+  read("time_scale", sim.time_scale_);
+  read("latency_us", sim.latency_us_);
+  read("fault_rate", sim.fault_rate_);
+  read("seed", sim.seed_);
+  if (sim.devices_ == 0 || sim.time_scale_ <= 0 || sim.liquid_capacity_ <= 0
+      || sim.spin_time_constant_ <= 0 || sim.fan_max_rpm_ <= 0
+      || sim.pump_max_rpm_ <= 0) {
+    throw std::runtime_error(
+      "simulation devices, time_scale, liquid_capacity, spin_time_constant "
+      "and max rpms must be greater than 0");
+  }
+  if (sim.fault_rate_ < 0 || sim.fault_rate_ > 1) {
+    throw std::runtime_error("simulation fault_rate must be within [0, 1]");
+  }
+  return sim;
+}
+
+void validate_config(const leviathan_config &options) {
+  if (options.interval_ == 0) {
+    throw std::runtime_error("interval must be greater than 0");
+  }
+  if (options.min_interval_ == 0
+      || options.min_interval_ > options.max_interval_) {
+    throw std::runtime_error(
+      "min_interval must be greater than 0 and at most max_interval");
+  }
+  if (options.telemetry_capacity_ == 0) {
+    throw std::runtime_error("telemetry_capacity must be greater than 0");
+  }
+  if (options.trace_window_ == 0 || options.trace_window_ > 600) {
+    throw std::runtime_error("trace_window must be within [1, 600] seconds");
+  }
+  if (options.usb_deadline_ == 0 || options.failsafe_ticks_ == 0
+      || options.reinit_ticks_ == 0) {
+    throw std::runtime_error(
+      "watchdog usb_deadline, failsafe_ticks and reinit_ticks must be "
+      "greater than 0");
+  }
+  if (options.pid_max_rate_ <= 0) {
+    throw std::runtime_error("pid max_rate must be greater than 0");
+  }
+  if (options.aggregation_k_ == 0) {
+    throw std::runtime_error("cpu_aggregation_k must be greater than 0");
+  }
+  if (!(options.ewma_alpha_ > 0.0f && options.ewma_alpha_ <= 1.0f)) {
+    throw std::runtime_error("cpu_ewma_alpha must be within (0, 1]");
+  }
+  if (options.main_color_ > 0xFFFFFF) {
+    throw std::runtime_error("main_color must be a 24 bit RGB value");
+  }
+  if (options.alternate_color_ > 0xFFFFFF) {
+    throw std::runtime_error("alternate_color must be a 24 bit RGB value");
+  }
+  if (options.lighting_interval_ == 0 || options.lighting_interval_ > 255) {
+    throw std::runtime_error("lighting_interval must be within [1, 255]");
+  }
+  if (options.temp_source_ == TempSource::FUSED
+      && options.fusion_sources_.empty()) {
+    throw std::runtime_error(
+      "temperature_source \"fused\" needs at least one fusion source");
+  }
+  double total_weight = 0;
+  for (const auto &source : options.fusion_sources_) {
+    if (source.weight_ < 0) {
+      throw std::runtime_error("fusion weights must not be negative");
+    }
+    total_weight += source.weight_;
+  }
+  if (options.fusion_mode_ == FusionMode::WEIGHTED
+      && !options.fusion_sources_.empty() && total_weight <= 0) {
+    throw std::runtime_error("fusion weights must not all be 0");
+  }
+  if (options.temp_source_ == TempSource::FUSED
+      && options.fusion_mode_ == FusionMode::MAX_CURVE
+      && options.controller_ != ControllerType::CURVE) {
+    throw std::runtime_error(
+      "fusion mode \"max_curve\" needs the \"curve\" controller");
+  }
+}
+
+// Only the settings that make sense per cooler can be set in a section,
+// sampling, interval and sockets are shared by every device
+leviathan_config parse_device_section(const YAML::Node &      section,
+                                      const leviathan_config &base) {
+  leviathan_config options = base;
+  options.devices_.clear();
+  if (section["temperature_source"]) {
+    options.temp_source_ =
+      stringToTempSource(section["temperature_source"].as<std::string>());
+  }
+  if (section["fan_profile"]) {
+    options.fan_profile_  = configure_profile(section["fan_profile"]);
+    options.pump_profile_ = options.fan_profile_;
+  }
+  if (section["pump_profile"]) {
+    options.pump_profile_ = configure_profile(section["pump_profile"]);
+  }
+  if (section["main_color"]) {
+    options.main_color_ = section["main_color"].as<uint32_t>();
+  }
+  parse_lighting(section, options);
+  if (section["controller"]) {
+    options.controller_ =
+      stringToControllerType(section["controller"].as<std::string>());
+  }
+  if (section["fusion"]) {
+    parse_fusion(section["fusion"], options);
+  }
+  validate_config(options);
+  return options;
+}
+
+const leviathan_config &device_config(const leviathan_config &config,
+                                      const std::string &     serial) {
+  const auto it = config.devices_.find(serial);
+  return it == config.devices_.end() ? config : *it->second;
+}
+
+std::optional<leviathan_config> try_parse_config_file(const char *const path) {
   leviathan_config options;
   try {
     YAML::Node config     = YAML::LoadFile(path);
@@ -52,10 +438,114 @@ leviathan_config parse_config_file(const char *const path) {
     options.fan_profile_  = configure_profile(config["fan_profile"]);
     options.pump_profile_ = config["pump_profile"] ? configure_profile(config["pump_profile"]) : options.fan_profile_;
     options.main_color_   = config["main_color"].as<uint32_t>();
+    parse_lighting(config, options);
     options.interval_     = config["interval"].as<uint32_t>();
-    options.conky_file_   = config["conky_file"].as<std::string>();
+    if (config["conky_file"]) {
+      options.conky_file_ = config["conky_file"].as<std::string>();
+    }
+    if (config["temperature_backend"]) {
+      options.temp_backend_ =
+        stringToTempBackend(config["temperature_backend"].as<std::string>());
+    }
+    if (config["telemetry_file"]) {
+      options.telemetry_file_ = config["telemetry_file"].as<std::string>();
+    }
+    if (config["telemetry_capacity"]) {
+      options.telemetry_capacity_ = config["telemetry_capacity"].as<uint32_t>();
+    }
+    if (config["metrics_socket"]) {
+      options.metrics_socket_ = config["metrics_socket"].as<std::string>();
+    }
+    if (config["control_socket"]) {
+      options.control_socket_ = config["control_socket"].as<std::string>();
+    }
+    if (config["session_file"]) {
+      options.session_file_ = config["session_file"].as<std::string>();
+    }
+    if (config["trace_file"]) {
+      options.trace_file_ = config["trace_file"].as<std::string>();
+    }
+    if (config["trace_window"]) {
+      options.trace_window_ = config["trace_window"].as<uint32_t>();
+    }
+    if (config["interval_mode"]) {
+      options.adaptive_interval_ =
+        parse_interval_mode(config["interval_mode"].as<std::string>());
+    }
+    if (config["min_interval"]) {
+      options.min_interval_ = config["min_interval"].as<uint32_t>();
+    }
+    if (config["max_interval"]) {
+      options.max_interval_ = config["max_interval"].as<uint32_t>();
+    }
+    if (config["controller"]) {
+      options.controller_ =
+        stringToControllerType(config["controller"].as<std::string>());
+    }
+    if (const YAML::Node pid = config["pid"]) {
+      if (pid["setpoint"]) {
+        options.pid_setpoint_ = pid["setpoint"].as<double>();
+      }
+      if (pid["max_rate"]) {
+        options.pid_max_rate_ = pid["max_rate"].as<double>();
+      }
+      options.fan_pid_  = parse_pid_gains(pid["fan"], options.fan_pid_);
+      options.pump_pid_ = parse_pid_gains(pid["pump"], options.pump_pid_);
+    }
+    if (config["cpu_aggregation"]) {
+      options.temp_aggregation_ =
+        stringToTempAggregation(config["cpu_aggregation"].as<std::string>());
+    }
+    if (config["cpu_aggregation_k"]) {
+      options.aggregation_k_ = config["cpu_aggregation_k"].as<uint32_t>();
+    }
+    if (config["cpu_ewma_alpha"]) {
+      options.ewma_alpha_ = config["cpu_ewma_alpha"].as<float>();
+    }
+    if (config["sensors"]) {
+      options.sensors_ = parse_sensors(config["sensors"]);
+    }
+    if (config["fusion"]) {
+      parse_fusion(config["fusion"], options);
+    }
+    if (const YAML::Node watchdog = config["watchdog"]) {
+      if (watchdog["tick_deadline"]) {
+        options.tick_deadline_ = watchdog["tick_deadline"].as<uint32_t>();
+      }
+      if (watchdog["usb_deadline"]) {
+        options.usb_deadline_ = watchdog["usb_deadline"].as<uint32_t>();
+      }
+      if (watchdog["failsafe_ticks"]) {
+        options.failsafe_ticks_ = watchdog["failsafe_ticks"].as<uint32_t>();
+      }
+      if (watchdog["reinit_ticks"]) {
+        options.reinit_ticks_ = watchdog["reinit_ticks"].as<uint32_t>();
+      }
+    }
+    if (config["simulation"]) {
+      options.simulation_ = parse_simulation(config["simulation"]);
+    }
+    if (config["usb_transport"]) {
+      options.usb_transport_ =
+        stringToUsbTransport(config["usb_transport"].as<std::string>());
+    }
+    validate_config(options);
+    if (const YAML::Node devices = config["devices"]) {
+      for (const auto &device : devices) {
+        const auto serial = device.first.as<std::string>();
+        options.devices_[serial] = std::make_shared<const leviathan_config>(
+          parse_device_section(device.second, options));
+      }
+    }
   } catch (std::exception &e) {
-    LOG(FATAL) << "Yaml parsing error: " << e.what();
+    LOG(ERROR) << "Invalid config file " << path << ": " << e.what();
+    return std::nullopt;
   }
   return options;
 }
+
+leviathan_config parse_config_file(const char *const path) {
+  auto options = try_parse_config_file(path);
+  LOG_IF(FATAL, !options) << "Unable to load config file: " << path;
+  return *options;
+}
@@ -1,20 +1,80 @@
 #ifndef LEVIATHAN_CONFIG_H
 #define LEVIATHAN_CONFIG_H
 
+#include "color_packet.hpp"
 #include "constants.h"
+#include "simulation_config.hpp"
+#include "temperature_aggregation.hpp"
+#include "temperature_monitor.hpp"
+#include <algorithm>
+#include <array>
 #include <functional>
 #include <map>
+#include <memory>
+#include <optional>
 #include <string>
+#include <vector>
+
+namespace YAML {
+class Node;
+}
 
 #define DEFAULT_RED 0xFF0000
 
+// Duty cycle limits accepted by the Kraken, in percent
+#define kMinDuty 30
+#define kMaxDuty 100
+
+// Anything above this is a failed sensor read, see TemperatureMonitor
+#define kMaxPlausibleTemp 200
+
+// Temperatures at or above the last entry saturate to it
+#define kProfileTableSize 128
+
 using LineFunction = std::function<int32_t(int32_t)>;
 
-enum class TempSource { CPU, LIQUID };
+// FUSED combines the CPU, liquid and hwmon sensors as set up under fusion
+enum class TempSource { CPU, LIQUID, FUSED };
 
-inline TempSource stringToTempSource(const std::string &tss) {
-  return tss == "liquid" ? TempSource::LIQUID : TempSource::CPU;
-}
+TempSource  stringToTempSource(const std::string &tss);
+const char *tempSourceToString(TempSource source);
+
+// Slots of the per tick source temperatures, hwmon sensors follow in order
+#define kCpuSource 0
+#define kLiquidSource 1
+#define kFirstHwmonSource 2
+#define kMaxTempSources 8
+
+// Extra temperature input, such as a GPU, NVMe drive or chipset, read from
+// tempN_input of the first hwmon device with the given chip name
+struct hwmon_sensor {
+  std::string name_;  // Used by fusion sources
+  std::string chip_;
+  uint32_t    input_{1};
+
+  bool operator==(const hwmon_sensor &other) const {
+    return name_ == other.name_ && chip_ == other.chip_
+           && input_ == other.input_;
+  }
+};
+
+// WEIGHTED feeds the weighted mean of the sources to the controller,
+// MAX_CURVE runs every source through its own curves and takes the highest
+// duty cycle
+enum class FusionMode { WEIGHTED, MAX_CURVE };
+
+enum class ControllerType { CURVE, PID };
+
+// SYNC blocks the control loop on every transfer, ASYNC queues them as one
+// libusb batch per tick, THREAD hands the latest command to a usb I/O thread
+// per device
+enum class UsbTransport { SYNC, ASYNC, THREAD };
+
+struct PidGains {
+  double kp;
+  double ki;
+  double kd;
+};
 
 struct Point {
   int32_t x;
@@ -22,22 +82,133 @@ struct Point {
   Point(int32_t __x, int32_t __y) : x(__x), y(__y) {}
 };
 
+// Fan/pump curve evaluated for every whole degree at config load, so a
+// lookup is a clamp and a single load from a contiguous table
+struct CompiledProfile {
+  std::array<uint8_t, kProfileTableSize> duty_{};
+
+  uint32_t lookup(const uint32_t temp) const {
+    return duty_[std::min<uint32_t>(temp, kProfileTableSize - 1)];
+  }
+};
+
+struct fusion_source {
+  uint32_t        index_;  // Slot, see kCpuSource
+  double          weight_{1.0};
+  CompiledProfile fan_profile_;
+  CompiledProfile pump_profile_;
+};
+
+// Color gradient over the control temperature, interpolated per channel for
+// every whole degree at config load. Empty unless color_gradient is set.
+struct CompiledGradient {
+  std::array<uint32_t, kProfileTableSize> rgb_{};
+  bool                                    enabled_{false};
+
+  uint32_t lookup(const uint32_t temp) const {
+    return rgb_[std::min<uint32_t>(temp, kProfileTableSize - 1)];
+  }
+};
+
 struct leviathan_config {
   // Fan/pump profile
-  TempSource                      temp_source_{TempSource::CPU};
-  std::map<int32_t, LineFunction> fan_profile_;
-  std::map<int32_t, LineFunction> pump_profile_;
+  TempSource      temp_source_{TempSource::CPU};
+  TempBackend     temp_backend_{TempBackend::LMSENSORS};
+
+  // Per-core CPU sampling, PACKAGE reads the package sensor only
+  TempAggregation temp_aggregation_{TempAggregation::PACKAGE};
+  uint32_t        aggregation_k_{2};    // Cores averaged by top_k_mean
+  float           ewma_alpha_{0.3f};    // Smoothing factor of ewma_max
 
-  // conky integration
+  // Sampled every tick next to the CPU, shared by every device
+  std::vector<hwmon_sensor> sensors_;
+  // Only used with TempSource::FUSED
+  FusionMode                 fusion_mode_{FusionMode::WEIGHTED};
+  std::vector<fusion_source> fusion_sources_;
+
+  CompiledProfile fan_profile_;
+  CompiledProfile pump_profile_;
+
+  // Controller settings, the curve profiles above are only used by CURVE
+  ControllerType controller_{ControllerType::CURVE};
+  double         pid_setpoint_{60.0};  // C
+  double         pid_max_rate_{10.0};  // Duty percent per second
+  PidGains       fan_pid_{4.0, 0.2, 2.0};
+  PidGains       pump_pid_{2.0, 0.1, 1.0};
+
+  // conky integration, an empty path disables the text file. The shared
+  // memory status page is always published.
   std::string conky_file_{kDefaultConkyFile};
 
-  // Color settings
-  uint32_t main_color_{DEFAULT_RED};
+  // Telemetry history, disabled while telemetry_file_ is empty
+  std::string telemetry_file_;
+  uint32_t    telemetry_capacity_{1 << 20};  // Records, ~6 days at 500ms
+
+  // Prometheus endpoint, disabled while metrics_socket_ is empty. Only read
+  // on startup.
+  std::string metrics_socket_;
+
+  // Runtime override commands, disabled while control_socket_ is empty. Only
+  // read on startup.
+  std::string control_socket_;
 
-  // Interval settings
+  // Records every tick and usb frame of the session into session_file_ for
+  // levd_replay, disabled while empty. Only read on startup.
+  std::string session_file_;
+
+  // SIGUSR2 captures trace_window_ seconds of tick stages into trace_file_
+  // as Chrome trace-event JSON, disabled while trace_file_ is empty
+  std::string trace_file_;
+  uint32_t    trace_window_{10};  // s
+
+  // Color settings. Effects are run by the Kraken itself, interval is the
+  // length of one phase of ALTERNATE and BLINK.
+  uint32_t     main_color_{DEFAULT_RED};
+  LightingMode lighting_mode_{LightingMode::STATIC};
+  uint32_t     alternate_color_{0x000000};
+  uint32_t     lighting_interval_{1};  // s
+  // Replaces main_color_ when enabled
+  CompiledGradient color_gradient_;
+
+  // Interval settings, adaptive mode varies the period between
+  // min_interval_ and max_interval_ and uses interval_ as its baseline
   uint32_t interval_{500};
+  bool     adaptive_interval_{false};
+  uint32_t min_interval_{250};
+  uint32_t max_interval_{5000};
+
+  // USB settings
+  UsbTransport usb_transport_{UsbTransport::THREAD};
+
+  // Watchdog. A tick is unhealthy if it overran tick_deadline_ (the current
+  // interval while 0) or ticks were missed, a sensor read failed, or a
+  // connected Kraken reported no status for usb_deadline_. failsafe_ticks_
+  // unhealthy ticks in a row force full duty, every reinit_ticks_ more
+  // re-initialize sensors and Krakens.
+  uint32_t tick_deadline_{0};     // ms
+  uint32_t usb_deadline_{15000};  // ms
+  uint32_t failsafe_ticks_{3};
+  uint32_t reinit_ticks_{20};
+
+  // Only used when the daemon runs with --simulate
+  simulation_config simulation_;
+
+  // Per device sections keyed by Kraken serial number. Each is a complete
+  // config with the section's keys applied on top of this one, devices
+  // without a section are driven by this config.
+  std::map<std::string, std::shared_ptr<const leviathan_config>> devices_;
 };
 
-leviathan_config parse_config_file(const char *const path);
+// Section for the given serial number, or config itself if there is none
+const leviathan_config &device_config(const leviathan_config &config,
+                                      const std::string &     serial);
+
+LineFunction    slope_function(const Point &a, const Point &b);
+CompiledProfile configure_profile(const YAML::Node &profile);
+CompiledGradient configure_gradient(const YAML::Node &gradient);
+
+// Returns nullopt and logs the reason if the file is missing or invalid
+std::optional<leviathan_config> try_parse_config_file(const char *const path);
+leviathan_config                parse_config_file(const char *const path);
 
 #endif  // LEVIATHAN_CONFIG_H
@@ -1,27 +1,59 @@
 #include "leviathan_service.hpp"
+#include "adaptive_interval.hpp"
+#include "config_watcher.hpp"
+#include "control_server.hpp"
 #include "constants.h"  // #defines
-#include "cpu_temperature_monitor.hpp"
+#include "event_loop.hpp"
+#include "fast_start.hpp"
+#include "fan_controller.hpp"
 #include "kraken_driver.hpp"
 #include "leviathan_config.hpp"
+#include "metrics.hpp"
+#include "metrics_server.hpp"
+#include "overrides.hpp"
+#include "sensor_registry.hpp"
+#include "session_trace.hpp"
+#include "simulated_kraken.hpp"
+#include "temperature_aggregation.hpp"
+#include "temperature_fusion.hpp"
+#include "status_page.hpp"
+#include "telemetry_ring.hpp"
+#include "tick_trace.hpp"
+#include "temperature_monitor.hpp"
+#include "usb_async_transfer.hpp"
+#include "usb_worker.hpp"
+#include "watchdog.hpp"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
-#include <fstream>
+#include <functional>
+#include <future>
 #include <glog/logging.h>
 #include <limits>
-#include <thread>
+#include <mutex>
+#include <vector>
 
+#include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
-#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <time.h>
 #include <unistd.h>
 
 using namespace std::chrono_literals;
 
-// Global kill all armed when SIGTERM is detected
-volatile sig_atomic_t done = 0;
-void                  term(int signum) { done = 1; }
+#define kMinReconnectBackoff 250ms
+#define kMaxReconnectBackoff 30s
+// Removals the hotplug callback holds until the control thread takes them
+#define kMaxPendingUnplugs 8
+// The fast start cache holds the peak duty of the last one to two windows
+#define kFastStartPeakWindow 10min
+// Enough for the conky block of every device
+#define kConkyBufferSize 2048
 
 /** *********** Private Interface ************** */
 
@@ -37,145 +69,1361 @@ bool detect_kraken(libusb_device *device) {
          && desc.idProduct == KRAKEN_X61_PRODUCT;
 }
 
-uint32_t next_speed(const std::map<int32_t, LineFunction> &fan_profile,
-                    const uint32_t                         current_temp) {
-  const auto slopeFn = fan_profile.upper_bound(current_temp)->second;
-  return slopeFn(current_temp);
+// The status page is optional, the daemon runs fine without it
+std::unique_ptr<StatusPage> open_status_page(size_t device, bool simulated) {
+  try {
+    return std::make_unique<StatusPage>(
+      status_page_name(device, simulated).c_str());
+  } catch (std::exception &e) {
+    LOG(ERROR) << "Status page disabled: " << e.what();
+    return nullptr;
+  }
 }
 
-int file_is_modified(const char *path, time_t oldMTime) {
-  struct stat file_stat;
-  int         err = stat(path, &file_stat);
-  LOG_IF(FATAL, err != 0) << "Error when attempting to stat " << path;
-  return file_stat.st_mtime > oldMTime;
+// Telemetry is optional, failing to open the file only disables it
+std::unique_ptr<TelemetryRing> open_telemetry(const leviathan_config &config) {
+  if (config.telemetry_file_.empty()) {
+    return nullptr;
+  }
+  try {
+    auto ring = std::make_unique<TelemetryRing>(config.telemetry_file_,
+                                                config.telemetry_capacity_);
+    LOG(INFO) << "Recording telemetry to " << config.telemetry_file_;
+    return ring;
+  } catch (std::exception &e) {
+    LOG(ERROR) << "Telemetry disabled: " << e.what();
+    return nullptr;
+  }
 }
 
-void update_conky_file(std::ostream &     ostream,
-                       const std::string &serial,
-                       const uint32_t     fan_speed,
-                       const uint32_t     pump_speed,
-                       const uint32_t     water_temp) {
-  std::stringstream ss;
-  ss << "Kraken Serial: " << serial << std::endl;
-  ss << "Fan Speed: " << fan_speed << std::endl;
-  ss << "Pump Speed: " << pump_speed << std::endl;
-  ss << "Water Temp: " << water_temp << std::endl;
-  ostream.seekp(0);
-  ostream << ss.str();
+// Capturing is optional as well
+std::unique_ptr<SessionRecorder> open_session(const leviathan_config &config) {
+  if (config.session_file_.empty()) {
+    return nullptr;
+  }
+  try {
+    auto recorder = std::make_unique<SessionRecorder>(config.session_file_);
+    LOG(INFO) << "Capturing the session to " << config.session_file_;
+    return recorder;
+  } catch (std::exception &e) {
+    LOG(ERROR) << "Session capture disabled: " << e.what();
+    return nullptr;
+  }
 }
 
-/** *********** Public Interface ************** */
+uint64_t realtime_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
-libusb_device *leviathan_init(libusb_device **devices, ssize_t num_devices) {
-  libusb_device *kraken_device = NULL;
-  for (auto i = 0u; i < num_devices; ++i) {
-    if (detect_kraken(devices[i])) {
-      kraken_device = devices[i];
-      break;
+// libusb completes async transfers and reports hotplug events from its own
+// fds (event pipe, timerfd, usbfs). Register them with the event loop and
+// track additions/removals. after_events runs once libusb has returned.
+// libusb reports a change on the thread that opened or closed the device,
+// such as the thread of an open. Changes are queued and applied by the
+// control thread, which owns the loop.
+struct usb_fd_change {
+  int   fd;
+  short events;
+  bool  added;
+};
+
+struct usb_watch {
+  usb_watch(EventLoop &event_loop, std::function<void()> handler)
+    : loop(event_loop)
+    , after_events(std::move(handler))
+    , wake_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    PCHECK(wake_fd >= 0) << "Failed to create eventfd";
+  }
+  usb_watch(const usb_watch &) = delete;
+  ~usb_watch() { close(wake_fd); }
+
+  EventLoop &                loop;
+  std::function<void()>      after_events;
+  int                        wake_fd;  // eventfd, signals queued changes
+  std::mutex                 lock;
+  std::vector<usb_fd_change> changes;  // Guarded by lock
+};
+
+void add_usb_fd(usb_watch &watch, int fd, short events) {
+  watch.loop.add(fd, events, [&watch](uint32_t) {
+    handle_pending_usb_events();
+    watch.after_events();
+  });
+}
+
+void queue_usb_fd_change(usb_watch &watch, const usb_fd_change &change) {
+  std::lock_guard<std::mutex> guard(watch.lock);
+  watch.changes.push_back(change);
+  const uint64_t one = 1;
+  PLOG_IF(ERROR, write(watch.wake_fd, &one, sizeof(one)) != sizeof(one))
+    << "Failed to signal usb fd change";
+}
+
+void usb_fd_added(int fd, short events, void *user_data) {
+  queue_usb_fd_change(*static_cast<usb_watch *>(user_data), {fd, events, true});
+}
+
+void usb_fd_removed(int fd, void *user_data) {
+  queue_usb_fd_change(*static_cast<usb_watch *>(user_data), {fd, 0, false});
+}
+
+// In the order they happened. libusb reports a removal before closing the fd
+// and waits on the lock to do so, an fd stays open while its addition is
+// applied. An addition already followed by its removal is skipped, the fd
+// may be closed by now.
+void apply_usb_fd_changes(usb_watch &watch) {
+  uint64_t count;
+  if (read(watch.wake_fd, &count, sizeof(count)) != sizeof(count)) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(watch.lock);
+  const auto &changes = watch.changes;
+  for (auto change = changes.begin(); change != changes.end(); ++change) {
+    if (!change->added) {
+      watch.loop.remove(change->fd);
+    } else if (std::none_of(change + 1, changes.end(),
+                            [&](const usb_fd_change &later) {
+                              return !later.added && later.fd == change->fd;
+                            })) {
+      add_usb_fd(watch, change->fd, change->events);
     }
   }
-  return kraken_device;
+  watch.changes.clear();
+}
+
+void watch_usb_fds(usb_watch &watch) {
+  LOG_IF(WARNING, !libusb_pollfds_handle_timeouts(NULL))
+    << "libusb requires explicit timeout handling, transfers may only time "
+       "out on the next tick";
+  watch.loop.add(watch.wake_fd, EPOLLIN,
+                 [&watch](uint32_t) { apply_usb_fd_changes(watch); });
+  const libusb_pollfd **pollfds = libusb_get_pollfds(NULL);
+  CHECK(pollfds != NULL) << "Failed to retrieve libusb pollfds";
+  for (const libusb_pollfd **it = pollfds; *it != NULL; ++it) {
+    add_usb_fd(watch, (*it)->fd, (*it)->events);
+  }
+  libusb_free_pollfds(pollfds);
+  libusb_set_pollfd_notifiers(NULL, usb_fd_added, usb_fd_removed, &watch);
+}
+
+void unwatch_usb_fds() { libusb_set_pollfd_notifiers(NULL, NULL, NULL, NULL); }
+
+// The metrics endpoint is optional, failing to bind only disables it
+std::unique_ptr<MetricsServer> open_metrics_server(
+  const leviathan_config &config,
+  const PublishedMetrics &metrics) {
+  if (config.metrics_socket_.empty()) {
+    return nullptr;
+  }
+  try {
+    return std::make_unique<MetricsServer>(config.metrics_socket_, metrics);
+  } catch (std::exception &e) {
+    LOG(ERROR) << "Metrics disabled: " << e.what();
+    return nullptr;
+  }
 }
 
-void leviathan_start(libusb_device *kraken_device) {
-  // Init Kraken, display diagnostics
-  auto kd = std::make_unique<KrakenDriver>(kraken_device);
+// Overrides are optional too, without the socket only the config applies
+std::unique_ptr<ControlServer> open_control_server(
+  const leviathan_config &config,
+  EventLoop &             loop,
+  OverrideMailbox &       mailbox) {
+  if (config.control_socket_.empty()) {
+    return nullptr;
+  }
+  try {
+    return std::make_unique<ControlServer>(config.control_socket_, loop,
+                                           mailbox);
+  } catch (std::exception &e) {
+    LOG(ERROR) << "Control socket disabled: " << e.what();
+    return nullptr;
+  }
+}
+
+
+// One Kraken and everything its control loop carries over between ticks. The
+// state outlives the driver, kd is null while the device is disconnected.
+struct kraken_state {
+  kraken_state(std::unique_ptr<KrakenDriver> driver,
+               libusb_device *               device,
+               const std::string &           serial_number,
+               size_t                        device_index,
+               const leviathan_config &      base_config)
+    : kraken_device(device ? libusb_ref_device(device) : nullptr)
+    , index(device_index)
+    , kd(std::move(driver))
+    , serial(serial_number)
+    , config(&device_config(base_config, serial))
+    , controller(make_fan_controller(config->controller_))
+    , status_page(open_status_page(device_index, device == nullptr)) {}
+  kraken_state(const kraken_state &) = delete;
+  ~kraken_state() {
+    usb_worker.reset(nullptr);
+    kd.reset(nullptr);
+    if (kraken_device) {
+      libusb_unref_device(kraken_device);
+    }
+  }
+
+  libusb_device *                kraken_device;  // Referenced, null if
+                                                 // simulated
+  // Opens the device again after a failure, set for devices that can't be
+  // found by scanning the bus
+  std::function<std::unique_ptr<KrakenDriver>()> reopen;
+  const size_t                   index;          // In detection order
+  std::unique_ptr<KrakenDriver>  kd;
+  std::unique_ptr<UsbWorker>     usb_worker;  // Drives kd in THREAD mode
+  std::string                    serial;  // Cached, a usb transfer
+  const leviathan_config *       config;  // Section for serial, owned by
+                                          // leviathan_state::config
+  std::unique_ptr<FanController> controller;
+  std::unique_ptr<StatusPage>    status_page;
+
+  uint32_t control_temp   = 0;  // Of the last tick, indexes the gradient
+  uint32_t old_fan_speed  = 0;  // Take first reported value as
+  uint32_t old_pump_speed = 0;  // .. an update
+  // Highest duty of the current and the previous kFastStartPeakWindow, the
+  // next start applies it under boot load
+  DutyCycle                             peak_duty          = {0, 0};
+  DutyCycle                             previous_peak_duty = {0, 0};
+  std::chrono::steady_clock::time_point peak_window_start{
+    std::chrono::steady_clock::now()};
+  KrakenStatus status = {};  // Latest status frame from Kraken
+  // Of the last valid status, or of the (re)connection. Watched against
+  // usb_deadline_.
+  std::chrono::steady_clock::time_point last_status{
+    std::chrono::steady_clock::now()};
+};
+
+using usb_device_ref = std::unique_ptr<libusb_device, void (*)(libusb_device *)>;
+
+// A Kraken being opened on its own thread. INIT and the serial number read
+// can each take up to kKrakenUsbTimeout on a device that doesn't answer,
+// which must not stall a tick.
+struct kraken_open {
+  std::future<std::unique_ptr<KrakenDriver>> driver;
+  usb_device_ref kraken_device;  // Found by scanning the bus, or null
+  kraken_state * device;         // Reopened through its reopen, or null
+};
+
+// A driver whose usb I/O thread is still finishing an update. The worker is
+// joined on a thread of its own, the driver closed once that is done.
+struct retired_driver {
+  std::unique_ptr<KrakenDriver> kd;
+  std::future<void>             joined;  // Destroyed first, waits for the join
+};
+
+// Everything the control loop carries over from one tick to the next, sensors
+// are sampled once per tick and shared by every Kraken
+struct leviathan_state {
+  // A simulation provides its own CPU sensor
+  explicit leviathan_state(const char *config_path = kDefaultConfigFile,
+                           bool        simulate    = false)
+    : simulated(simulate)
+    , config_watcher(config_path)
+    , config(config_watcher.current())
+    , config_generation(config_watcher.generation())
+    , cpu_temp_mon(simulate ? nullptr
+                            : make_temperature_monitor(config->temp_backend_))
+    , sensor_registry(std::make_unique<SensorRegistry>(config->sensors_))
+    , telemetry(open_telemetry(*config))
+    , session(open_session(*config))
+    , conky_tmp_file(config->conky_file_ + ".tmp") {}
+
+  const bool                              simulated;
+  ConfigWatcher                           config_watcher;
+  std::shared_ptr<const leviathan_config> config;
+  uint64_t                                config_generation;
+  std::unique_ptr<TemperatureMonitor>     cpu_temp_mon;
+  std::unique_ptr<SensorRegistry>         sensor_registry;
+  std::unique_ptr<TelemetryRing>          telemetry;
+  std::unique_ptr<SessionRecorder>        session;
+  // The conky file is formatted into conky_buffer and written through
+  // conky_tmp_file, nothing is allocated when it changes
+  std::string                             conky_tmp_file;
+  std::array<char, kConkyBufferSize>      conky_buffer;
+  std::chrono::steady_clock::time_point   last_tick{
+    std::chrono::steady_clock::now()};
+  uint64_t                                ticks = 0;
+
+  std::vector<std::unique_ptr<kraken_state>> devices;
+  // Drivers dropped while their usb I/O thread was busy, see retire_driver.
+  // Declared after session, they may still record to it.
+  std::vector<retired_driver> retired;
+
+  // Reconnection state machine. While a device is missing or failed to open
+  // the bus is rescanned with exponential backoff, a hotplug arrival
+  // rescans right away.
+  struct {
+    bool                                  pending = false;
+    std::chrono::steady_clock::time_point next_attempt;
+    std::chrono::milliseconds backoff{kMinReconnectBackoff};
+    std::vector<kraken_open>  opens;  // Adopted once they finish
+  } reconnect;
+
+  // Written by the hotplug callback on whichever thread handles libusb
+  // events, only atomics are shared with it. A null slot is free.
+  struct {
+    std::atomic<bool> arrived{false};
+    std::array<std::atomic<libusb_device *>, kMaxPendingUnplugs> unplugged{};
+  } hotplug;
+
+  // Per-core samples, refilled in place every tick
+  std::array<int32_t, kMaxCoreSamples> core_temps;
+  TemperatureAggregator                aggregator;
+  // Fusion inputs of the current tick, see kCpuSource
+  std::array<int32_t, kMaxTempSources> source_temps;
+  // Bit per slot a device controlled from this tick, only those can fail it
+  uint32_t read_sources = 0;
+
+  // Delay until the next tick, fixed or chosen by the adaptive interval
+  std::chrono::milliseconds next_interval{0};
+  AdaptiveInterval          adaptive_interval;
+
+  // Sensor and usb health are filled in by the tick, the deadline by the
+  // loop that timed it
+  tick_health     health = {};
+  ControlWatchdog watchdog;
+
+  // Only written by the control loop, published once per tick for the
+  // metrics endpoint
+  metrics_snapshot metrics = {};
+  PublishedMetrics published_metrics;
+
+  // Temporary overrides posted by the control socket, applied on top of the
+  // config of every device and drained at the start of every tick
+  OverrideMailbox override_mailbox;
+  Overrides       overrides;
+};
+
+// Takes ownership of a freshly opened driver, handing it back to the state of
+// the same serial or adding a new device
+void adopt_kraken(leviathan_state &             state,
+                  std::unique_ptr<KrakenDriver> kd,
+                  libusb_device *               kraken_device) {
+  const std::string serial = kd->getSerialNumber();
+  for (auto &device : state.devices) {
+    if (!device->kd && device->serial == serial) {
+      libusb_unref_device(device->kraken_device);
+      device->kraken_device = libusb_ref_device(kraken_device);
+      device->kd            = std::move(kd);
+      device->last_status   = std::chrono::steady_clock::now();
+      ++state.metrics.reconnects;
+      LOG(INFO) << serial << ": reconnected";
+      return;
+    }
+  }
+  if (state.devices.size() == kMaxMetricsDevices) {
+    LOG(WARNING) << "Only the first " << kMaxMetricsDevices
+                 << " Krakens are driven, ignoring " << serial;
+    return;
+  }
   LOG(INFO) << "Kraken Driver Initialized";
-  LOG(INFO) << "Kraken Serial No: " << kd->getSerialNumber();
-
-  // The following two lines throw/crash on config error
-  CpuTemperatureMonitor cpu_temp_mon;
-  auto                  config_opts = parse_config_file(kDefaultConfigFile);
-  std::ofstream         conky_oss(config_opts.conky_file_);
-
-  // Local variables for state management
-  uint32_t cpu_temp           = 0;
-  uint32_t liquid_temp        = 0;
-  uint32_t old_fan_speed      = 0;  // Take first reported value as
-  uint32_t old_pump_speed     = 0;  // .. an update
-  time_t   last_time_modified = std::numeric_limits<time_t>::min();
-
-  // Init signal handler
-  struct sigaction action;
-  memset(&action, 0, sizeof(struct sigaction));
-  action.sa_handler = term;
-  sigaction(SIGTERM, &action, NULL);
-  sigaction(SIGQUIT, &action, NULL);
-  sigaction(SIGINT, &action, NULL);
-
-  // Main program loop
-  // 1. Update config_options if config file was edited
-  // 2. Update color according to the given settings
-  // 3. Read CPU and liquid temperatures
-  // 4. Set fan/pump speed according to temp and given parameters
-  // 5. Sleep for the defined interval and repeat
-  while (!done) {
-    // Grab latest parameters, if they've been changed
-    if (file_is_modified(kDefaultConfigFile, last_time_modified)) {
-      LOG(INFO)
-        << "Detected modifications to config file, updating preferences...";
-      config_opts        = parse_config_file(kDefaultConfigFile);
-      last_time_modified = time(0);
-    }
-
-    // Update color, which also provides the liquid temp in case it's needed.
-    kd->setColor(config_opts.main_color_);
-    auto update = kd->sendColorUpdate();
-
-    // Grab latest cpu and liquid temperatures
-    cpu_temp    = cpu_temp_mon.getPackageIdTemperature();
-    liquid_temp = update.find("liquid_temperature")->second;
-
-    // Based on parameters and current temp, set desired fan and pump speeds
-    uint32_t next_fan, next_pump;
-    if (config_opts.temp_source_ == TempSource::LIQUID) {
-      next_fan  = next_speed(config_opts.fan_profile_, liquid_temp);
-      next_pump = next_speed(config_opts.pump_profile_, liquid_temp);
-      VLOG(2) << "Current liquid temperature: " << liquid_temp << "C";
+  LOG(INFO) << "Kraken Serial No: " << serial
+            << (state.config->devices_.count(serial)
+                  ? ", using its own config section"
+                  : "");
+  state.devices.push_back(std::make_unique<kraken_state>(
+    std::move(kd), kraken_device, serial, state.devices.size(),
+    *state.config));
+}
+
+// Driven already, or being opened
+bool is_driven(const leviathan_state &state, libusb_device *kraken_device) {
+  for (const auto &device : state.devices) {
+    if (device->kd && device->kraken_device == kraken_device) {
+      return true;
+    }
+  }
+  for (const auto &open : state.reconnect.opens) {
+    if (open.kraken_device.get() == kraken_device) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool is_reopening(const leviathan_state &state, const kraken_state &device) {
+  for (const auto &open : state.reconnect.opens) {
+    if (open.device == &device) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Adopts every open that has finished, a failed one is retried by the next
+// rescan. With wait set, blocks until all of them have finished. Once nothing
+// is missing the reconnect state machine is reset, the next loss starts over
+// at the shortest backoff.
+void collect_kraken_opens(leviathan_state &state, bool wait = false) {
+  auto &opens  = state.reconnect.opens;
+  bool  failed = false;
+  for (auto open = opens.begin(); open != opens.end();) {
+    if (!wait
+        && open->driver.wait_for(std::chrono::seconds(0))
+             != std::future_status::ready) {
+      ++open;
+      continue;
+    }
+    try {
+      auto kd = open->driver.get();
+      if (open->device) {
+        open->device->kd          = std::move(kd);
+        open->device->last_status = std::chrono::steady_clock::now();
+        ++state.metrics.reconnects;
+        LOG(INFO) << open->device->serial << ": reconnected";
+      } else {
+        adopt_kraken(state, std::move(kd), open->kraken_device.get());
+      }
+    } catch (std::exception &e) {
+      LOG(WARNING) << "Unable to open "
+                   << (open->device ? open->device->serial : "Kraken")
+                   << ": " << e.what();
+      failed = true;
+    }
+    open = opens.erase(open);
+  }
+  bool missing = failed || !opens.empty();
+  for (const auto &device : state.devices) {
+    missing |= !device->kd;
+  }
+  if (!missing) {
+    state.reconnect.pending = false;
+    state.reconnect.backoff = kMinReconnectBackoff;
+  }
+}
+
+// Starts opening every Kraken on the bus that isn't driven yet, the opens
+// run on their own threads and are adopted by collect_kraken_opens.
+// Reschedules itself with a doubled backoff while any device is still
+// missing or being opened.
+void rescan_krakens(leviathan_state &                     state,
+                    libusb_device **                      kraken_devices,
+                    ssize_t                               num_devices,
+                    std::chrono::steady_clock::time_point now) {
+  auto &reconnect = state.reconnect;
+  for (auto &device : state.devices) {
+    if (device->kd || !device->reopen || is_reopening(state, *device)) {
+      continue;
+    }
+    reconnect.opens.push_back(
+      {std::async(std::launch::async, device->reopen),
+       usb_device_ref(nullptr, libusb_unref_device), device.get()});
+  }
+  for (ssize_t i = 0; i < num_devices; ++i) {
+    libusb_device *const kraken_device = kraken_devices[i];
+    if (!detect_kraken(kraken_device) || is_driven(state, kraken_device)) {
+      continue;
+    }
+    reconnect.opens.push_back(
+      {std::async(std::launch::async,
+                  [kraken_device]() {
+                    return std::make_unique<KrakenDriver>(kraken_device);
+                  }),
+       usb_device_ref(libusb_ref_device(kraken_device), libusb_unref_device),
+       nullptr});
+  }
+
+  reconnect.pending = !reconnect.opens.empty();
+  for (const auto &device : state.devices) {
+    reconnect.pending |= !device->kd;
+  }
+  if (reconnect.pending) {
+    reconnect.next_attempt = now + reconnect.backoff;
+    VLOG(1) << "Kraken still missing, next attempt in "
+            << reconnect.backoff.count() << "ms";
+    reconnect.backoff = std::min<std::chrono::milliseconds>(
+      reconnect.backoff * 2, kMaxReconnectBackoff);
+  } else {
+    reconnect.backoff = kMinReconnectBackoff;
+  }
+}
+
+void rescan_krakens(leviathan_state &                     state,
+                    std::chrono::steady_clock::time_point now) {
+  if (state.simulated) {
+    rescan_krakens(state, NULL, 0, now);
+    return;
+  }
+  libusb_device **devices;
+  const ssize_t   num_devices = libusb_get_device_list(NULL, &devices);
+  if (num_devices < 0) {
+    LOG(ERROR) << "Failed to list usb devices: "
+               << libusb_error_name(num_devices);
+    return;
+  }
+  rescan_krakens(state, devices, num_devices, now);
+  libusb_free_device_list(devices, true);
+}
+
+// Joining a usb I/O thread waits for the update it is sending, several
+// transfers of up to kKrakenUsbTimeout each. The worker is joined on a thread
+// of its own instead, the driver is closed by reap_retired_drivers once that
+// is done, closing it elsewhere would report its fds from a foreign thread.
+// Without a worker nothing is on the bus in sync mode, and cancelling an
+// async batch only takes a round of libusb events, both are dropped right
+// away.
+void retire_driver(leviathan_state &state, kraken_state &device) {
+  if (device.usb_worker) {
+    state.retired.push_back(
+      {std::move(device.kd),
+       std::async(std::launch::async,
+                  [worker = std::move(device.usb_worker)]() mutable {
+                    worker.reset(nullptr);
+                  })});
+  }
+  device.kd.reset(nullptr);
+}
+
+void reap_retired_drivers(leviathan_state &state) {
+  auto &retired = state.retired;
+  retired.erase(std::remove_if(retired.begin(), retired.end(),
+                               [](const retired_driver &driver) {
+                                 return driver.joined.wait_for(
+                                          std::chrono::seconds(0))
+                                        == std::future_status::ready;
+                               }),
+                retired.end());
+}
+
+// Drops the driver without blocking, the reconnect state machine brings the
+// device back. Sampling and publishing carry on in the meantime.
+void drop_kraken(leviathan_state &                     state,
+                 kraken_state &                        device,
+                 std::chrono::steady_clock::time_point now) {
+  retire_driver(state, device);
+  device.status = KrakenStatus{};
+  if (!state.reconnect.pending) {
+    state.reconnect.pending      = true;
+    state.reconnect.backoff      = kMinReconnectBackoff;
+    state.reconnect.next_attempt = now + state.reconnect.backoff;
+  }
+}
+
+void disconnect_kraken(leviathan_state &                     state,
+                       kraken_state &                        device,
+                       std::chrono::steady_clock::time_point now) {
+  LOG(WARNING) << device.serial << ": lost connection, reconnecting...";
+  drop_kraken(state, device, now);
+}
+
+// Only records the event, libusb must not be re-entered from its callback.
+// It runs on any thread handling libusb events, usb I/O and open threads
+// included, handle_hotplug acts on it on the control thread. Without a free
+// slot the removal is dropped, the next failed transfer catches it.
+int LIBUSB_CALL on_kraken_hotplug(libusb_context *     context,
+                                  libusb_device *      kraken_device,
+                                  libusb_hotplug_event event,
+                                  void *               user_data) {
+  auto &hotplug = static_cast<leviathan_state *>(user_data)->hotplug;
+  if (event == LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED) {
+    hotplug.arrived.store(true);
+    return 0;
+  }
+  for (auto &slot : hotplug.unplugged) {
+    libusb_device *expected = nullptr;
+    if (slot.compare_exchange_strong(expected, kraken_device)) {
+      break;
+    }
+  }
+  return 0;  // Stay registered
+}
+
+void handle_hotplug(leviathan_state &state) {
+  const auto now = std::chrono::steady_clock::now();
+  for (auto &slot : state.hotplug.unplugged) {
+    libusb_device *const kraken_device = slot.exchange(nullptr);
+    if (!kraken_device) {
+      continue;
+    }
+    for (auto &device : state.devices) {
+      if (device->kd && device->kraken_device == kraken_device) {
+        disconnect_kraken(state, *device, now);
+      }
+    }
+  }
+  if (state.hotplug.arrived.exchange(false)) {
+    state.reconnect.backoff = kMinReconnectBackoff;
+    rescan_krakens(state, now);
+  }
+}
+
+// Written to a temporary file and renamed over path, so readers only ever
+// see a complete file. One block per Kraken, formatted into buffer.
+void update_conky_file(const std::string &                               path,
+                       const std::string &                               tmp_path,
+                       const std::vector<std::unique_ptr<kraken_state>> &devices,
+                       std::array<char, kConkyBufferSize> &              buffer) {
+  size_t length = 0;
+  for (const auto &device : devices) {
+    const int n = snprintf(
+      buffer.data() + length, buffer.size() - length,
+      "Kraken Serial: %s\nFan Speed: %u\nPump Speed: %u\nWater Temp: %u\n",
+      device->serial.c_str(), device->status.fan_rpm, device->status.pump_rpm,
+      device->status.liquid_temp);
+    if (n < 0 || length + n >= buffer.size()) {
+      LOG(WARNING) << "conky file truncated after " << length << " bytes";
+      break;
+    }
+    length += n;
+  }
+  const int fd =
+    open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0) {
+    PLOG(WARNING) << "Failed to open " << tmp_path;
+    return;
+  }
+  const bool written =
+    write(fd, buffer.data(), length) == static_cast<ssize_t>(length);
+  PLOG_IF(WARNING, !written) << "Failed to write " << tmp_path;
+  close(fd);
+  if (!written) {
+    return;
+  }
+  PLOG_IF(WARNING, rename(tmp_path.c_str(), path.c_str()) != 0)
+    << "Failed to rename " << tmp_path << " to " << path;
+}
+
+// Package sensor, or every core sampled in one pass and reduced according to
+// the configured aggregation
+uint32_t read_cpu_temperature(leviathan_state &       state,
+                              const leviathan_config &config) {
+  if (config.temp_aggregation_ != TempAggregation::PACKAGE) {
+    const size_t n = state.cpu_temp_mon->sampleCoreTemperatures(
+      state.core_temps.data(), state.core_temps.size());
+    if (n > 0) {
+      return state.aggregator.aggregate(
+        config.temp_aggregation_, state.core_temps.data(), n,
+        config.aggregation_k_, config.ewma_alpha_);
+    }
+  }
+  return state.cpu_temp_mon->getPackageIdTemperature();
+}
+
+// Swaps in the latest config snapshot and rebuilds whatever depends on a
+// setting that changed
+void apply_config_reload(leviathan_state &state) {
+  const auto previous     = state.config;
+  state.config_generation = state.config_watcher.generation();
+  state.config            = state.config_watcher.current();
+  state.conky_tmp_file    = state.config->conky_file_ + ".tmp";
+  ++state.metrics.config_reloads;
+  if (state.config->telemetry_file_ != previous->telemetry_file_
+      || state.config->telemetry_capacity_ != previous->telemetry_capacity_) {
+    state.telemetry.reset(nullptr);
+    state.telemetry = open_telemetry(*state.config);
+  }
+  if (state.config->temp_backend_ != previous->temp_backend_
+      && !state.simulated) {
+    try {
+      state.cpu_temp_mon =
+        make_temperature_monitor(state.config->temp_backend_);
+    } catch (std::exception &e) {
+      LOG(ERROR) << "Unable to switch temperature backend, keeping the "
+                    "previous one: "
+                 << e.what();
+    }
+  }
+  if (state.config->sensors_ != state.sensor_registry->sensors()) {
+    try {
+      state.sensor_registry =
+        std::make_unique<SensorRegistry>(state.config->sensors_);
+    } catch (std::exception &e) {
+      // Stale slots would feed the wrong sensor, read them as failed instead
+      LOG(ERROR) << "Unable to open sensors, fused sources fail safe: "
+                 << e.what();
+      state.sensor_registry =
+        std::make_unique<SensorRegistry>(std::vector<hwmon_sensor>{});
+    }
+  }
+  if (state.config->usb_transport_ != UsbTransport::THREAD) {
+    for (auto &device : state.devices) {
+      // The I/O thread may still be using the driver, it is reopened for
+      // the new transport
+      if (device->usb_worker) {
+        LOG(INFO) << device->serial << ": switching usb transport";
+        drop_kraken(state, *device, std::chrono::steady_clock::now());
+      }
+    }
+  }
+  for (auto &device : state.devices) {
+    const ControllerType controller = device->config->controller_;
+    device->config = &device_config(*state.config, device->serial);
+    if (device->config->controller_ != controller) {
+      device->controller = make_fan_controller(device->config->controller_);
+    }
+  }
+}
+
+// Override, gradient color at the last control temperature or main color
+uint32_t device_color(leviathan_state &                      state,
+                      const kraken_state &                   device,
+                      std::chrono::steady_clock::time_point now) {
+  const leviathan_config &config = *device.config;
+  return state.overrides.color(config.color_gradient_.enabled_
+                                 ? config.color_gradient_.lookup(
+                                     device.control_temp)
+                                 : config.main_color_,
+                               now);
+}
+
+ColorPacket device_color_packet(leviathan_state &                      state,
+                                const kraken_state &                   device,
+                                std::chrono::steady_clock::time_point now) {
+  const leviathan_config &config = *device.config;
+  return ColorPacket()
+    .color(device_color(state, device, now))
+    .alternateColor(config.alternate_color_)
+    .interval(config.lighting_interval_)
+    .mode(config.lighting_mode_);
+}
+
+// Picks up the status of the last update the usb I/O thread finished, if
+// any. Starts the thread for a newly connected device.
+void collect_usb_result(leviathan_state &                     state,
+                        kraken_state &                        device,
+                        std::chrono::steady_clock::time_point now) {
+  if (!device.usb_worker) {
+    device.usb_worker = std::make_unique<UsbWorker>(*device.kd);
+    return;
+  }
+  usb_result result;
+  if (!device.usb_worker->poll(result)) {
+    return;
+  }
+  state.metrics.usb_commands_skipped += result.skipped;
+  if (!result.status.valid) {
+    ++state.metrics.usb_errors;
+    disconnect_kraken(state, device, now);
+    return;
+  }
+  state.metrics.usb_round_trip.observe(
+    std::chrono::nanoseconds(result.round_trip_ns));
+  device.status      = result.status;
+  device.last_status = now;
+}
+
+// Sends the color if the effect changed, the status read that follows
+// refreshes the liquid temp early. Otherwise the liquid temp is the one read
+// after the previous speed update. In async mode the status comes from the
+// batch queued on a previous tick, in thread mode from the last update the
+// I/O thread finished, so the loop never waits on the bus.
+void begin_device_tick(leviathan_state &                     state,
+                       kraken_state &                        device,
+                       std::chrono::steady_clock::time_point now) {
+  auto &kd = device.kd;
+  if (!kd) {
+    return;
+  }
+  if (!device.usb_worker) {
+    // Nobody else uses the driver yet
+    kd->recordTo(state.session.get(), device.index);
+  }
+  if (state.config->usb_transport_ == UsbTransport::THREAD) {
+    collect_usb_result(state, device, now);
+    return;
+  }
+  kd->setColor(device_color_packet(state, device, now));
+  if (state.config->usb_transport_ == UsbTransport::ASYNC) {
+    KrakenStatus update;
+    if (kd->pollUpdate(update)) {
+      if (!update.valid) {
+        ++state.metrics.usb_errors;
+        disconnect_kraken(state, device, now);
+      } else {
+        const auto     round_trip = kd->lastRoundTrip();
+        const uint64_t end        = monotonic_ns();
+        trace_span(TraceStage::USB_BATCH,
+                   end
+                     - std::chrono::duration_cast<std::chrono::nanoseconds>(
+                         round_trip)
+                         .count(),
+                   end);
+        state.metrics.usb_round_trip.observe(round_trip);
+        device.status      = update;
+        device.last_status = now;
+      }
+    }
+  } else if (kd->colorPending()) {
+    TraceSpan  span(TraceStage::COLOR_UPDATE);
+    const auto start = std::chrono::steady_clock::now();
+    device.status    = kd->sendColorUpdate();
+    if (!device.status.valid) {
+      ++state.metrics.usb_errors;
     } else {
-      next_fan  = next_speed(config_opts.fan_profile_, cpu_temp);
-      next_pump = next_speed(config_opts.pump_profile_, cpu_temp);
-      VLOG(2) << "Current CPU temperature: " << cpu_temp << "C";
+      state.metrics.usb_round_trip.observe(std::chrono::steady_clock::now()
+                                           - start);
+      device.last_status = now;
     }
-    // Step down: If we are decreasing fan/pump speed, do it slowly
-    if (next_fan < old_fan_speed) {
-      next_fan = old_fan_speed - 5;
+  }
+}
+
+void record_session_tick(leviathan_state &   state,
+                         const kraken_state &device,
+                         uint32_t            liquid_temp,
+                         TempSource          temp_source,
+                         const DutyCycle &   controlled,
+                         const DutyCycle &   duty) {
+  session_tick tick = {};
+  std::copy(state.source_temps.begin(), state.source_temps.end(),
+            tick.sources);
+  tick.sources[kLiquidSource] = liquid_temp;
+  tick.control_temp           = device.control_temp;
+  tick.temp_source            = static_cast<uint8_t>(temp_source);
+  tick.fan_duty               = duty.fan;
+  tick.pump_duty              = duty.pump;
+  tick.flags = duty.fan != controlled.fan || duty.pump != controlled.pump
+                   || state.watchdog.fullDuty()
+                 ? kSessionForced
+                 : 0;
+  state.session->record(SessionRecord::TICK, device.index, &tick,
+                        sizeof(tick));
+}
+
+// Sets fan/pump speed from the control temperature and publishes the result.
+// Returns the control temperature, changed is set if either duty cycle moved
+// since the last tick.
+uint32_t finish_device_tick(leviathan_state &                     state,
+                            kraken_state &                        device,
+                            uint32_t                              cpu_temp,
+                            double                                dt,
+                            std::chrono::steady_clock::time_point now,
+                            bool &                                changed) {
+  auto &                  kd          = device.kd;
+  const leviathan_config &config_opts = *device.config;
+  const TempSource        temp_source =
+    state.overrides.tempSource(config_opts.temp_source_, now);
+
+  const uint32_t liquid_temp = device.status.liquid_temp;
+  // Without a valid status frame, right after a (re)connect or a failed
+  // read, the liquid temp is unknown and fails safe like a CPU read would
+  const uint32_t control_liquid_temp =
+    device.status.valid ? liquid_temp : std::numeric_limits<int>::min();
+  const uint64_t controller_start = monotonic_ns();
+  uint32_t       control_temp =
+    temp_source == TempSource::LIQUID ? control_liquid_temp : cpu_temp;
+  DutyCycle controlled;
+  if (temp_source == TempSource::FUSED) {
+    for (const auto &source : config_opts.fusion_sources_) {
+      state.read_sources |= 1u << source.index_;
+    }
+    state.source_temps[kLiquidSource] = control_liquid_temp;
+    const fused_temperature fused =
+      fuse_temperatures(config_opts, state.source_temps.data());
+    control_temp = fused.temp;
+    controlled   = config_opts.fusion_mode_ == FusionMode::MAX_CURVE
+                   ? device.controller->follow(fused.duty, dt)
+                   : device.controller->update(control_temp, dt, config_opts);
+  } else {
+    state.read_sources |= temp_source == TempSource::CPU ? 1u << kCpuSource : 0;
+    controlled = device.controller->update(control_temp, dt, config_opts);
+  }
+  device.control_temp = control_temp;
+  VLOG(2) << device.serial << ": current " << tempSourceToString(temp_source)
+          << " temperature: " << control_temp << "C";
+  // The watchdog's failsafe beats any override
+  const DutyCycle duty = state.watchdog.fullDuty()
+                           ? DutyCycle{kMaxDuty, kMaxDuty}
+                           : state.overrides.duty(controlled, now);
+  trace_span(TraceStage::CONTROLLER, controller_start, monotonic_ns());
+  if (state.session) {
+    record_session_tick(state, device, control_liquid_temp, temp_source,
+                        controlled, duty);
+  }
+  const uint32_t next_fan  = duty.fan;
+  const uint32_t next_pump = duty.pump;
+  VLOG(2) << "Setting fan speed: " << next_fan;
+  VLOG(2) << "Setting pump speeds: " << next_pump;
+  if (!kd) {
+    // Disconnected, keep the controller running and publish what's known
+  } else if (state.config->usb_transport_ == UsbTransport::THREAD) {
+    if (device.usb_worker) {
+      device.usb_worker->send(
+        {device_color_packet(state, device, now), next_fan, next_pump});
     }
-    if (next_pump < old_pump_speed) {
-      next_pump = old_pump_speed - 5;
+  } else if (state.config->usb_transport_ == UsbTransport::ASYNC) {
+    kd->setFanSpeed(next_fan);
+    kd->setPumpSpeed(next_pump);
+    if (!kd->queueUpdate()) {
+      VLOG(2) << "Previous usb batch still in flight, skipping this tick";
     }
-    VLOG(2) << "Setting fan speed: " << next_fan;
-    VLOG(2) << "Setting pump speeds: " << next_pump;
+  } else {
+    TraceSpan span(TraceStage::SPEED_UPDATE);
     kd->setFanSpeed(next_fan);
     kd->setPumpSpeed(next_pump);
-    update = kd->sendSpeedUpdate();
-    if (update.empty() == true) {
-      LOG(WARNING) << "Bad update detected, attempting reconnection...";
-      // NOTE: Must ensure that destructor of old object pointed to by kd
-      // is cleaned up before reassignment to a new instance of kraken
-      // driver. i.e. only one can be alive at any given time.
-      kd.reset(nullptr);
-      std::this_thread::sleep_for(5s);
-      kd.reset(new KrakenDriver(kraken_device));
-    }
-
-    if (next_fan != old_fan_speed || next_pump != old_pump_speed) {
-      const auto fan_speed  = update.find("fan_speed")->second;
-      const auto pump_speed = update.find("pump_speed")->second;
-      LOG(INFO) << "Changed fan speed to " << fan_speed << "rpm, pump speed to "
-                << pump_speed << "rpm, with fan percentage at " << next_fan
-                << ", with pump percentage at " << next_pump
-                << ", current CPU temperature at " << cpu_temp << "C"
-                << ", and current liquid temperature at " << liquid_temp << "C";
-      update_conky_file(conky_oss, kd->getSerialNumber(), fan_speed, pump_speed,
-                        liquid_temp);
-      old_fan_speed  = next_fan;
-      old_pump_speed = next_pump;
-    }
-
-    std::this_thread::sleep_for(
-      std::chrono::milliseconds(config_opts.interval_));
-  }
-
-  kd.reset(nullptr);
+    const auto start = std::chrono::steady_clock::now();
+    device.status    = kd->sendSpeedUpdate();
+    if (!device.status.valid) {
+      ++state.metrics.usb_errors;
+      disconnect_kraken(state, device, now);
+    } else {
+      state.metrics.usb_round_trip.observe(std::chrono::steady_clock::now()
+                                           - start);
+      device.last_status = now;
+    }
+  }
+
+  const uint64_t publish_start = monotonic_ns();
+  const uint32_t fan_rpm       = device.status.fan_rpm;
+  const uint32_t pump_rpm      = device.status.pump_rpm;
+  if (state.telemetry) {
+    telemetry_record record = {0};
+    record.timestamp_ns     = realtime_ns();
+    record.cpu_temp         = cpu_temp;
+    record.liquid_temp      = liquid_temp;
+    record.fan_rpm          = fan_rpm;
+    record.pump_rpm         = pump_rpm;
+    record.fan_duty         = next_fan;
+    record.pump_duty        = next_pump;
+    record.device           = device.index;
+    state.telemetry->append(record);
+  }
+
+  if (device.status_page) {
+    levd_status page = {0};
+    page.updated_ns  = realtime_ns();
+    page.ticks       = state.ticks;
+    strncpy(page.serial, device.serial.c_str(), sizeof(page.serial) - 1);
+    page.cpu_temp    = cpu_temp;
+    page.liquid_temp = liquid_temp;
+    page.fan_rpm     = fan_rpm;
+    page.pump_rpm    = pump_rpm;
+    page.color       = device_color(state, device, now);
+    page.fan_duty    = next_fan;
+    page.pump_duty   = next_pump;
+    page.connected   = device.kd != nullptr;
+    device.status_page->publish(page);
+  }
+
+  device_metrics &metrics = state.metrics.devices[device.index];
+  strncpy(metrics.serial, device.serial.c_str(), sizeof(metrics.serial) - 1);
+  metrics.liquid_temp = liquid_temp;
+  metrics.fan_duty    = next_fan;
+  metrics.pump_duty   = next_pump;
+  metrics.fan_rpm     = fan_rpm;
+  metrics.pump_rpm    = pump_rpm;
+  metrics.connected   = device.kd != nullptr;
+  trace_span(TraceStage::PUBLISH, publish_start, monotonic_ns());
+
+  if (now - device.peak_window_start >= kFastStartPeakWindow) {
+    device.previous_peak_duty = device.peak_duty;
+    device.peak_duty          = {0, 0};
+    device.peak_window_start  = now;
+  }
+  device.peak_duty.fan  = std::max(device.peak_duty.fan, next_fan);
+  device.peak_duty.pump = std::max(device.peak_duty.pump, next_pump);
+
+  changed = next_fan != device.old_fan_speed
+            || next_pump != device.old_pump_speed;
+  if (changed) {
+    LOG(INFO) << device.serial << ": changed fan speed to " << fan_rpm
+              << "rpm, pump speed to " << pump_rpm
+              << "rpm, with fan percentage at " << next_fan
+              << ", with pump percentage at " << next_pump
+              << ", current CPU temperature at " << cpu_temp << "C"
+              << ", and current liquid temperature at " << liquid_temp << "C";
+    device.old_fan_speed  = next_fan;
+    device.old_pump_speed = next_pump;
+  }
+  return control_temp;
+}
+
+// 1. Pick up the latest config snapshot if the watcher published one
+// 2. Update color of every Kraken according to the given settings
+// 3. Read CPU temperature once, liquid temperatures per Kraken
+// 4. Set fan/pump speed of every Kraken according to temp and its parameters
+void control_tick(leviathan_state &state) {
+  TraceSpan span(TraceStage::TICK);
+  // Grab latest parameters, if they've been changed. Parsing happened on
+  // the watcher thread, this is only an atomic load.
+  if (state.config_watcher.generation() != state.config_generation) {
+    TraceSpan span(TraceStage::CONFIG_RELOAD);
+    apply_config_reload(state);
+  }
+  const leviathan_config &config_opts = *state.config;
+  const auto              now         = std::chrono::steady_clock::now();
+  state.overrides.drain(state.override_mailbox, now);
+
+  if (config_opts.usb_transport_ == UsbTransport::ASYNC) {
+    TraceSpan span(TraceStage::USB_EVENTS);
+    handle_pending_usb_events();
+  }
+  handle_hotplug(state);
+  if (!state.reconnect.opens.empty()) {
+    collect_kraken_opens(state);
+  }
+  if (!state.retired.empty()) {
+    reap_retired_drivers(state);
+  }
+  if (state.reconnect.pending && now >= state.reconnect.next_attempt) {
+    TraceSpan span(TraceStage::RECONNECT);
+    rescan_krakens(state, now);
+  }
+  for (auto &device : state.devices) {
+    begin_device_tick(state, *device, now);
+  }
+
+  // One sensor pass serves every device
+  const uint64_t sensors_start = monotonic_ns();
+  const uint32_t cpu_temp      = read_cpu_temperature(state, config_opts);
+  state.source_temps.fill(std::numeric_limits<int>::min());
+  state.source_temps[kCpuSource] = cpu_temp;
+  state.sensor_registry->sample(state.source_temps.data());
+  trace_span(TraceStage::SENSORS, sensors_start, monotonic_ns());
+  const double   dt =
+    std::chrono::duration<double>(now - state.last_tick).count();
+  state.last_tick = now;
+  ++state.ticks;
+
+  // The hottest device sets the pace of the adaptive interval
+  state.read_sources    = 0;
+  uint32_t control_temp = 0;
+  bool     any_changed  = false;
+  for (auto &device : state.devices) {
+    bool changed = false;
+    control_temp = std::max(
+      control_temp,
+      finish_device_tick(state, *device, cpu_temp, dt, now, changed));
+    any_changed |= changed;
+  }
+
+  // A sensor no device reads, the CPU under liquid control or a hwmon input
+  // left out of fusion, doesn't make the tick unhealthy
+  state.health.sensor_failed =
+    (state.read_sources & 1u << kCpuSource) && cpu_temp > kMaxPlausibleTemp;
+  for (size_t i = 0; i < state.sensor_registry->sensors().size(); ++i) {
+    const int32_t temp = state.source_temps[kFirstHwmonSource + i];
+    state.health.sensor_failed |=
+      (state.read_sources & 1u << (kFirstHwmonSource + i))
+      && (temp < 0 || temp > kMaxPlausibleTemp);
+  }
+  if (any_changed && !config_opts.conky_file_.empty()) {
+    TraceSpan span(TraceStage::CONKY_FILE);
+    update_conky_file(config_opts.conky_file_, state.conky_tmp_file,
+                      state.devices, state.conky_buffer);
+  }
+
+  state.health.usb_stale = false;
+  for (const auto &device : state.devices) {
+    state.health.usb_stale |=
+      device->kd
+      && now - device->last_status
+           > std::chrono::milliseconds(config_opts.usb_deadline_);
+  }
+
+  state.metrics.ticks       = state.ticks;
+  state.metrics.cpu_temp    = cpu_temp;
+  state.metrics.num_devices = state.devices.size();
+
+  state.next_interval =
+    config_opts.adaptive_interval_
+      ? state.adaptive_interval.update(control_temp, config_opts)
+      : std::chrono::milliseconds(config_opts.interval_);
+}
+
+// Re-initializes what failed in the ticks leading up to it. Stalled Krakens
+// are dropped, the reconnect state machine brings them back with a fresh INIT.
+// Sensors are reopened after a failed read. A missed deadline has no single
+// culprit and re-initializes both. lm-sensors reads sysfs on every call and
+// can't be set up twice, it is kept as is.
+void watchdog_reinit(leviathan_state &                     state,
+                     std::chrono::steady_clock::time_point now) {
+  const tick_health &causes = state.watchdog.reinitCauses();
+  LOG(ERROR) << "Watchdog: re-initializing"
+             << (causes.sensor_failed || causes.deadline_missed ? " sensors"
+                                                                 : "")
+             << (causes.usb_stale || causes.deadline_missed ? " Krakens" : "");
+  ++state.metrics.watchdog_reinits;
+  const auto usb_deadline =
+    std::chrono::milliseconds(state.config->usb_deadline_);
+  for (auto &device : state.devices) {
+    const bool stale = now - device->last_status > usb_deadline;
+    if (device->kd && (causes.deadline_missed || stale)) {
+      disconnect_kraken(state, *device, now);
+    }
+  }
+  if (!causes.sensor_failed && !causes.deadline_missed) {
+    return;
+  }
+  try {
+    if (!state.simulated
+        && state.config->temp_backend_ == TempBackend::HWMON) {
+      state.cpu_temp_mon = make_temperature_monitor(TempBackend::HWMON);
+    }
+    state.sensor_registry =
+      std::make_unique<SensorRegistry>(state.config->sensors_);
+  } catch (std::exception &e) {
+    LOG(ERROR) << "Unable to reopen sensors: " << e.what();
+  }
+}
+
+// Feeds the watchdog after a tick. elapsed is the time the tick took,
+// expirations the ticks the timer fired for it.
+void check_tick_health(leviathan_state &                     state,
+                       uint64_t                              expirations,
+                       std::chrono::steady_clock::duration   elapsed,
+                       std::chrono::milliseconds             interval,
+                       std::chrono::steady_clock::time_point now) {
+  const leviathan_config &config   = *state.config;
+  const auto              deadline = config.tick_deadline_ > 0
+                                       ? std::chrono::milliseconds(
+                                           config.tick_deadline_)
+                                       : interval;
+  state.health.deadline_missed     = expirations > 1 || elapsed > deadline;
+  state.metrics.deadline_misses += state.health.deadline_missed;
+  state.metrics.sensor_failures += state.health.sensor_failed;
+  if (state.watchdog.update(state.health, config)) {
+    watchdog_reinit(state, now);
+  }
+  state.metrics.failsafe = state.watchdog.fullDuty();
+}
+
+/** *********** Public Interface ************** */
+
+std::vector<libusb_device *> leviathan_init(libusb_device **devices,
+                                            ssize_t         num_devices) {
+  std::vector<libusb_device *> kraken_devices;
+  for (auto i = 0u; i < num_devices; ++i) {
+    if (detect_kraken(devices[i])) {
+      kraken_devices.push_back(devices[i]);
+    }
+  }
+  return kraken_devices;
+}
+
+void start_tick_trace(const leviathan_config &config) {
+  if (config.trace_file_.empty()) {
+    LOG(WARNING) << "Set trace_file to capture a trace";
+  } else if (start_trace_capture(std::chrono::seconds(config.trace_window_))) {
+    LOG(INFO) << "Capturing " << config.trace_window_ << "s of tick trace to "
+              << config.trace_file_;
+  }
+}
+
+// Runs the event loop until a termination signal, for real and simulated
+// devices alike
+void run_control_loop(leviathan_state &state, SignalFd &signals) {
+  // Arrivals and removals are reported by libusb as they happen, without it
+  // the backoff rescans still find devices that come back
+  libusb_hotplug_callback_handle hotplug_handle;
+  const bool                     hotplug =
+    !state.simulated && libusb_has_capability(LIBUSB_CAP_HAS_HOTPLUG)
+    && libusb_hotplug_register_callback(
+         NULL,
+         static_cast<libusb_hotplug_event>(
+           LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED
+           | LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT),
+         static_cast<libusb_hotplug_flag>(0), KRAKEN_X61_VENDOR,
+         KRAKEN_X61_PRODUCT, LIBUSB_HOTPLUG_MATCH_ANY, on_kraken_hotplug,
+         &state, &hotplug_handle)
+         == LIBUSB_SUCCESS;
+  LOG_IF(WARNING, !hotplug && !state.simulated)
+    << "usb hotplug unavailable, reconnecting by polling only";
+
+  // Main program loop, everything is driven by one epoll instance
+  // 1. Ticks of a drift free timerfd run control_tick
+  // 2. SIGTERM/SIGINT/SIGQUIT stop the loop immediately, SIGUSR1 logs the
+  //    stage latencies and SIGUSR2 starts a Chrome trace capture
+  // 3. libusb's own fds complete async transfers and report hotplug events
+  //    as soon as they happen
+  // 4. Metrics scrapes and override commands are answered between ticks
+  EventLoop       loop;
+  TickTimer       timer(std::chrono::milliseconds(state.config->interval_));
+  SystemdNotifier notifier;
+  const auto      longest_tick = std::chrono::milliseconds(
+    state.config->adaptive_interval_ ? state.config->max_interval_
+                                     : state.config->interval_);
+  LOG_IF(WARNING, notifier.watchdogInterval().count() > 0
+                    && longest_tick > notifier.watchdogInterval() / 2)
+    << "Ticks up to " << longest_tick.count()
+    << "ms are too slow for the systemd watchdog, raise WatchdogSec";
+  loop.add(signals.fd(), EPOLLIN, [&](uint32_t) {
+    const int signal = signals.consume();
+    if (signal == SIGUSR1) {
+      log_stage_histograms();
+    } else if (signal == SIGUSR2) {
+      start_tick_trace(*state.config);
+    } else if (signal != 0) {
+      LOG(INFO) << "Received signal " << strsignal(signal);
+      loop.stop();
+    }
+  });
+  loop.add(timer.fd(), EPOLLIN, [&](uint32_t) {
+    const uint64_t expirations = timer.consume();
+    LOG_IF(WARNING, expirations > 1)
+      << "Control loop missed " << expirations - 1 << " tick(s)";
+    const auto start = std::chrono::steady_clock::now();
+    control_tick(state);
+    const auto end = std::chrono::steady_clock::now();
+    state.metrics.tick_duration.observe(end - start);
+    check_tick_health(state, expirations, end - start, timer.interval(), end);
+    state.published_metrics.store(state.metrics);
+    if (!state.watchdog.abandoned()) {
+      notifier.ping(end);
+    }
+    finish_trace_capture(state.config->trace_file_);
+    if (state.next_interval != timer.interval()) {
+      timer.setInterval(state.next_interval);
+    }
+  });
+  usb_watch watch{loop, [&]() { handle_hotplug(state); }};
+  watch_usb_fds(watch);
+  const auto metrics_server =
+    open_metrics_server(*state.config, state.published_metrics);
+  const auto control_server =
+    open_control_server(*state.config, loop, state.override_mailbox);
+  notifier.notify("READY=1");
+  loop.run();
+  notifier.notify("STOPPING=1");
+  unwatch_usb_fds();
+  if (hotplug) {
+    libusb_hotplug_deregister_callback(NULL, hotplug_handle);
+  }
+
+  if (state.config->adaptive_interval_) {
+    state.adaptive_interval.reportSavings(*state.config);
+  }
+}
+
+// Opens the Kraken and commands the cached duty, or full duty without a
+// cache, before the config and sensors are ready. Returns null on failure,
+// the regular rescan retries the device.
+std::unique_ptr<KrakenDriver> fast_start_kraken(
+  libusb_device *                        kraken_device,
+  const std::optional<fast_start_cache> &cache,
+  double &                               first_fan_command) {
+  try {
+    auto kd = std::make_unique<KrakenDriver>(kraken_device);
+    kd->setFanSpeed(cache ? cache->fan_duty : kMaxDuty);
+    kd->setPumpSpeed(cache ? cache->pump_duty : kMaxDuty);
+    if (kd->sendSpeedUpdate().valid) {
+      first_fan_command = process_uptime().count();
+      LOG(INFO) << "First fan command " << first_fan_command * 1000
+                << "ms after start, "
+                << (cache ? "cached" : "full") << " duty";
+    }
+    return kd;
+  } catch (std::exception &e) {
+    LOG(WARNING) << "Fast start failed: " << e.what();
+    return nullptr;
+  }
+}
+
+// Remembers where the first Kraken sits on the bus and its recent peak duty
+// cycle. The last duty is usually the idle floor of a quiet shutdown, too
+// little for the load of the next boot.
+void save_fast_start(const leviathan_state &state) {
+  if (state.devices.empty() || !state.devices.front()->kraken_device) {
+    return;
+  }
+  const kraken_state &device = *state.devices.front();
+  fast_start_cache    cache  = {0};
+  cache.fan_duty =
+    std::max(device.peak_duty.fan, device.previous_peak_duty.fan);
+  cache.pump_duty =
+    std::max(device.peak_duty.pump, device.previous_peak_duty.pump);
+  if (cache.fan_duty == 0 || !usb_port_path(device.kraken_device, cache)) {
+    return;
+  }
+  write_fast_start_cache(kDefaultFastStartFile, cache);
+}
+
+void leviathan_start(const std::vector<libusb_device *> &kraken_devices) {
+  // Signals are delivered through the event loop. This must happen before
+  // any thread is spawned so they all inherit the blocked mask.
+  SignalFd signals({SIGTERM, SIGINT, SIGQUIT, SIGUSR1, SIGUSR2});
+
+  // Fast start, the Kraken from the last run (or the first one found) gets a
+  // safe duty on its own thread while the config is parsed and the sensors
+  // are set up on this one
+  auto           cache = read_fast_start_cache(kDefaultFastStartFile);
+  libusb_device *first =
+    cache ? find_cached_device(kraken_devices.data(), kraken_devices.size(),
+                               *cache)
+          : nullptr;
+  if (!first) {
+    // Moved or replaced, the cached duty belonged to another setup
+    cache.reset();
+    first = kraken_devices.empty() ? nullptr : kraken_devices.front();
+  }
+  double                                     first_fan_command = 0;
+  std::future<std::unique_ptr<KrakenDriver>> fast_start;
+  if (first) {
+    fast_start = std::async(std::launch::async, fast_start_kraken, first,
+                            cache, std::ref(first_fan_command));
+  }
+
+  // Init every Kraken, display diagnostics. The sensor monitor and config
+  // watcher throw/crash on config error, a Kraken that fails to open is
+  // retried by the reconnect state machine.
+  leviathan_state state;
+  if (auto kd = fast_start.valid() ? fast_start.get() : nullptr) {
+    adopt_kraken(state, std::move(kd), first);
+  }
+  state.metrics.first_fan_command = first_fan_command;
+  // Nothing to control yet, the first opens may block
+  rescan_krakens(state, const_cast<libusb_device **>(kraken_devices.data()),
+                 kraken_devices.size(), std::chrono::steady_clock::now());
+  collect_kraken_opens(state, true);
+  run_control_loop(state, signals);
+  save_fast_start(state);
+}
+
+// Every simulated Kraken cools its own model, the CPU sensor follows the
+// first one
+void add_simulated_krakens(leviathan_state &state) {
+  const simulation_config &sim = state.config->simulation_;
+  LOG(INFO) << "Simulating " << sim.devices_ << " Kraken(s) at "
+            << sim.time_scale_ << "x real time";
+  const uint32_t num_devices =
+    std::min<uint32_t>(sim.devices_, kMaxMetricsDevices);
+  for (uint32_t i = 0; i < num_devices; ++i) {
+    const auto        model  = std::make_shared<ThermalModel>(sim);
+    const std::string serial = "SIM_" + std::to_string(i);
+    const auto        reopen = [model, sim, serial]() {
+      return std::make_unique<KrakenDriver>(
+        std::make_unique<SimulatedKraken>(model, sim, serial));
+    };
+    if (!state.cpu_temp_mon) {
+      state.cpu_temp_mon = std::make_unique<SimulatedTemperatureMonitor>(model);
+    }
+    // An injected fault may already hit initialization, the reconnect state
+    // machine takes it from there
+    std::unique_ptr<KrakenDriver> kd;
+    try {
+      kd = reopen();
+    } catch (std::exception &e) {
+      LOG(WARNING) << "Unable to open " << serial << ": " << e.what();
+      state.reconnect.pending = true;
+    }
+    state.devices.push_back(std::make_unique<kraken_state>(
+      std::move(kd), nullptr, serial, i, *state.config));
+    state.devices.back()->reopen = reopen;
+  }
+}
+
+void leviathan_simulate() {
+  SignalFd        signals({SIGTERM, SIGINT, SIGQUIT, SIGUSR1, SIGUSR2});
+  leviathan_state state(kDefaultConfigFile, true);
+  add_simulated_krakens(state);
+  run_control_loop(state, signals);
+}
+
+/** *********** SimulatedService ************** */
+
+SimulatedService::SimulatedService(const char *const config_path)
+  : _state(std::make_unique<leviathan_state>(config_path, true)) {
+  add_simulated_krakens(*_state);
+}
+
+SimulatedService::~SimulatedService() = default;
+
+void SimulatedService::tick() { control_tick(*_state); }
+
+void SimulatedService::writeConkyFile(const std::string &path) const {
+  update_conky_file(path, path + ".tmp", _state->devices,
+                    _state->conky_buffer);
 }
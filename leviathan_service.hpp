@@ -2,8 +2,33 @@
 #define LEVIATHAN_SERVICE_H
 
 #include <libusb-1.0/libusb.h>
+#include <memory>
+#include <string>
+#include <vector>
 
-libusb_device *leviathan_init(libusb_device **devices, ssize_t num_devices);
-void leviathan_start(libusb_device *kraken_device);
+struct leviathan_state;
+
+// Every attached Kraken, in bus order
+std::vector<libusb_device *> leviathan_init(libusb_device **devices,
+                                            ssize_t         num_devices);
+void leviathan_start(const std::vector<libusb_device *> &kraken_devices);
+// Runs the same control loop against simulated Krakens and a simulated CPU,
+// configured by the simulation config section
+void leviathan_simulate();
+
+// The control loop of leviathan_simulate() without the event loop, ticks are
+// driven by the caller. Meant for benchmarks, nothing else runs in between.
+class SimulatedService {
+ public:
+  explicit SimulatedService(const char *const config_path);
+  SimulatedService(const SimulatedService &) = delete;
+  ~SimulatedService();
+
+  void tick();
+  void writeConkyFile(const std::string &path) const;
+
+ private:
+  std::unique_ptr<leviathan_state> _state;
+};
 
 #endif  // LEVIATHAN_SERVICE_H
@@ -0,0 +1,61 @@
+#include "libusb_transport.hpp"
+#include "usb_descriptor_utils.hpp"
+
+#include <glog/logging.h>
+#include <stdexcept>
+
+#define kMainConfigurationIndex 0
+#define kMainConfigurationValue 1
+
+LibusbTransport::LibusbTransport(libusb_device *kraken_device)
+  : _device(kraken_device)
+  , _desc(get_descriptor(_device))
+  , _config(get_config_descriptor(_device))
+  , _handle(get_handle(_device)) {
+  // Grab endpoints via libusb
+  if (_config->bConfigurationValue != kMainConfigurationValue) {
+    throw std::runtime_error("bConfigurationValue must equal: "
+                             + std::to_string(kMainConfigurationValue));
+  }
+  const int set_configuration_result =
+    libusb_set_configuration(_handle.get(), kMainConfigurationValue);
+  if (set_configuration_result != 0) {
+    throw std::runtime_error(
+      std::string("Error when setting kraken usb configuration, got: ")
+      + libusb_error_name(set_configuration_result));
+  }
+  const libusb_interface_descriptor main_interface =
+    get_main_usb_interface(_config.get());
+  const libusb_endpoint_descriptor *endpoints = main_interface.endpoint;
+  if (main_interface.bNumEndpoints != 2) {
+    throw std::runtime_error("Expecting only 2 endpoints");
+  }
+  set_endpoints(endpoints, _endpointIn, _endpointOut);
+  _batch = std::make_unique<AsyncTransferBatch>(_handle.get(),
+                                                _endpointOut.bEndpointAddress,
+                                                _endpointIn.bEndpointAddress);
+}
+
+LibusbTransport::~LibusbTransport() {
+  // Outstanding transfers must be cancelled before the handle is closed
+  _batch.reset(nullptr);
+}
+
+std::string LibusbTransport::serialNumber() {
+  return get_serial_number(_desc, _handle.get());
+}
+
+bool LibusbTransport::control(uint16_t value) {
+  return transfer_control_value(_handle.get(), value);
+}
+
+bool LibusbTransport::bulkOut(const unsigned char *data, const size_t length) {
+  // libusb never writes to the buffer of an OUT transfer
+  return transfer_bulk_raw_data(_handle.get(), _endpointOut.bEndpointAddress,
+                                const_cast<unsigned char *>(data), length);
+}
+
+bool LibusbTransport::bulkIn(unsigned char *data, const size_t length) {
+  return transfer_bulk_raw_data(_handle.get(), _endpointIn.bEndpointAddress,
+                                data, length);
+}
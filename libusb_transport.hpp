@@ -0,0 +1,53 @@
+#ifndef LIBUSB_TRANSPORT_H
+#define LIBUSB_TRANSPORT_H
+
+#include <libusb-1.0/libusb.h>
+#include <memory>
+#include <string>
+
+#include "kraken_transport.hpp"
+#include "usb_async_transfer.hpp"
+
+// The physical Kraken. Opens the device, selects kMainConfigurationValue and
+// finds the bulk endpoints.
+class LibusbTransport : public KrakenTransport {
+ public:
+  // Throws std::runtime_error if the device is gone or can't be set up
+  explicit LibusbTransport(libusb_device *kraken);
+  LibusbTransport(const LibusbTransport &) = delete;
+  ~LibusbTransport() override;
+
+  std::string serialNumber() override;
+
+  bool control(uint16_t value) override;
+  bool bulkOut(const unsigned char *data, const size_t length) override;
+  bool bulkIn(unsigned char *data, const size_t length) override;
+
+  TransferBatch &batch() override { return *_batch; }
+
+ private:
+  struct ConfigDeleter {
+    void operator()(libusb_config_descriptor *config) const {
+      libusb_free_config_descriptor(config);
+    }
+  };
+  struct HandleDeleter {
+    void operator()(libusb_device_handle *handle) const {
+      libusb_close(handle);
+    }
+  };
+
+  libusb_device *const           _device;  // Unowned
+  const libusb_device_descriptor _desc;
+
+  // Owned, released even if construction throws half way
+  const std::unique_ptr<libusb_config_descriptor, ConfigDeleter> _config;
+  const std::unique_ptr<libusb_device_handle, HandleDeleter>     _handle;
+
+  libusb_endpoint_descriptor _endpointOut;
+  libusb_endpoint_descriptor _endpointIn;
+
+  std::unique_ptr<AsyncTransferBatch> _batch;
+};
+
+#endif  // LIBUSB_TRANSPORT_H
@@ -2,6 +2,7 @@
 #include "leviathan_service.hpp"
 #include <glog/logging.h>
 #include <libusb-1.0/libusb.h>
+#include <string.h>
 
 int main(int argc, char *argv[]) {
   FLAGS_logtostderr = 1;
@@ -13,6 +14,14 @@ int main(int argc, char *argv[]) {
   const int rc = libusb_init(NULL);
   CHECK(rc == 0) << "Error initializing libusb: " << libusb_error_name(rc);
 
+  if (argc > 1 && strcmp(argv[1], "--simulate") == 0) {
+    LOG(INFO) << "Starting levd service against simulated devices...";
+    leviathan_simulate();
+    LOG(INFO) << "... driver gracefully shutting down";
+    libusb_exit(NULL);
+    return 0;
+  }
+
   libusb_device **devices;
   ssize_t         num_devices = libusb_get_device_list(NULL, &devices);
   if (num_devices == 0) {
@@ -21,11 +30,11 @@ int main(int argc, char *argv[]) {
   }
   LOG(INFO) << "libusb successfully initialized...";
   LOG(INFO) << "There are " << num_devices << " usb devices hooked up";
-  libusb_device *kraken_device = leviathan_init(devices, num_devices);
-  if (kraken_device) {
-    LOG(INFO) << "Kraken X61 is detected";
+  const auto kraken_devices = leviathan_init(devices, num_devices);
+  if (!kraken_devices.empty()) {
+    LOG(INFO) << kraken_devices.size() << " Kraken X61 detected";
     LOG(INFO) << "Starting levd service...";
-    leviathan_start(kraken_device);
+    leviathan_start(kraken_devices);
   } else {
     LOG(ERROR) << "Kraken X61 was not detected";
   }
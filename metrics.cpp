@@ -0,0 +1,111 @@
+#include "metrics.hpp"
+
+#include <cstdio>
+
+void append_metric(std::string &     out,
+                   const char *const name,
+                   const char *const type,
+                   const char *const help,
+                   double            value) {
+  char line[256];
+  snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s %s\n%s %.17g\n", name,
+           help, name, type, name, value);
+  out += line;
+}
+
+void append_device_metric(std::string &          out,
+                          const char *const      name,
+                          const char *const      help,
+                          const metrics_snapshot &metrics,
+                          double (*value)(const device_metrics &)) {
+  char line[256];
+  snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s gauge\n", name, help,
+           name);
+  out += line;
+  for (uint32_t i = 0; i < metrics.num_devices; ++i) {
+    const device_metrics &device = metrics.devices[i];
+    snprintf(line, sizeof(line), "%s{serial=\"%s\"} %.17g\n", name,
+             device.serial, value(device));
+    out += line;
+  }
+}
+
+void append_histogram(std::string &            out,
+                      const char *const        name,
+                      const char *const        help,
+                      const latency_histogram &histogram) {
+  char line[256];
+  snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s histogram\n", name,
+           help, name);
+  out += line;
+  uint64_t cumulative = 0;
+  for (size_t i = 0; i < kNumLatencyBuckets; ++i) {
+    cumulative += histogram.buckets[i];
+    snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", name,
+             kLatencyBuckets[i], static_cast<unsigned long long>(cumulative));
+    out += line;
+  }
+  snprintf(line, sizeof(line),
+           "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.17g\n%s_count %llu\n", name,
+           static_cast<unsigned long long>(histogram.count), name,
+           histogram.sum, name,
+           static_cast<unsigned long long>(histogram.count));
+  out += line;
+}
+
+std::string format_metrics(const metrics_snapshot &m) {
+  std::string out;
+  out.reserve(4096);
+  append_metric(out, "levd_cpu_temperature_celsius", "gauge",
+                "CPU temperature as seen by the controller", m.cpu_temp);
+  append_device_metric(
+    out, "levd_connected", "1 while the Kraken is responding", m,
+    [](const device_metrics &d) -> double { return d.connected; });
+  append_device_metric(
+    out, "levd_liquid_temperature_celsius",
+    "Coolant temperature reported by the Kraken", m,
+    [](const device_metrics &d) -> double { return d.liquid_temp; });
+  append_device_metric(
+    out, "levd_fan_duty_percent", "Fan duty cycle last sent to the Kraken", m,
+    [](const device_metrics &d) -> double { return d.fan_duty; });
+  append_device_metric(
+    out, "levd_pump_duty_percent", "Pump duty cycle last sent to the Kraken",
+    m, [](const device_metrics &d) -> double { return d.pump_duty; });
+  append_device_metric(
+    out, "levd_fan_rpm", "Fan speed reported by the Kraken", m,
+    [](const device_metrics &d) -> double { return d.fan_rpm; });
+  append_device_metric(
+    out, "levd_pump_rpm", "Pump speed reported by the Kraken", m,
+    [](const device_metrics &d) -> double { return d.pump_rpm; });
+  append_metric(out, "levd_first_fan_command_seconds", "gauge",
+                "Time from process start to the first fan command",
+                m.first_fan_command);
+  append_metric(out, "levd_failsafe", "gauge",
+                "1 while the watchdog forces full fan and pump duty",
+                m.failsafe);
+  append_metric(out, "levd_ticks_total", "counter",
+                "Control loop ticks since startup", m.ticks);
+  append_metric(out, "levd_reconnects_total", "counter",
+                "Successful reconnections to a Kraken", m.reconnects);
+  append_metric(out, "levd_usb_errors_total", "counter",
+                "Failed usb updates", m.usb_errors);
+  append_metric(out, "levd_usb_commands_skipped_total", "counter",
+                "Commands replaced before the usb thread sent them",
+                m.usb_commands_skipped);
+  append_metric(out, "levd_config_reloads_total", "counter",
+                "Successfully applied config reloads", m.config_reloads);
+  append_metric(out, "levd_deadline_misses_total", "counter",
+                "Ticks that overran their deadline or were skipped",
+                m.deadline_misses);
+  append_metric(out, "levd_sensor_failures_total", "counter",
+                "Ticks with a failed temperature read", m.sensor_failures);
+  append_metric(out, "levd_watchdog_reinits_total", "counter",
+                "Re-inits of sensors and Krakens by the watchdog",
+                m.watchdog_reinits);
+  append_histogram(out, "levd_tick_duration_seconds",
+                   "Time spent in a control tick", m.tick_duration);
+  append_histogram(out, "levd_usb_round_trip_seconds",
+                   "Time from sending an update to receiving its status",
+                   m.usb_round_trip);
+  return out;
+}
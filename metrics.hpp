@@ -0,0 +1,77 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "seqlock.hpp"
+
+// Upper bounds, in seconds, of the latency histogram buckets
+const double kLatencyBuckets[] = {0.0001, 0.00025, 0.0005, 0.001, 0.0025,
+                                  0.005,  0.01,    0.025,  0.05,  0.1,
+                                  0.25,   0.5,     1.0,    2.5,   5.0};
+#define kNumLatencyBuckets (sizeof(kLatencyBuckets) / sizeof(double))
+
+// Prometheus style histogram, buckets are not cumulative until formatted
+struct latency_histogram {
+  uint64_t buckets[kNumLatencyBuckets + 1];  // Last one is +Inf
+  uint64_t count;
+  double   sum;  // Seconds
+
+  void observe(std::chrono::steady_clock::duration elapsed) {
+    const double seconds = std::chrono::duration<double>(elapsed).count();
+    size_t       bucket  = 0;
+    while (bucket < kNumLatencyBuckets && seconds > kLatencyBuckets[bucket]) {
+      ++bucket;
+    }
+    ++buckets[bucket];
+    ++count;
+    sum += seconds;
+  }
+};
+
+#define kMaxMetricsDevices 8
+
+// Gauges of one Kraken, labelled with its serial number
+struct device_metrics {
+  char     serial[32];  // NUL terminated
+  int32_t  liquid_temp;
+  uint32_t fan_duty;
+  uint32_t pump_duty;
+  uint32_t fan_rpm;
+  uint32_t pump_rpm;
+  uint32_t connected;
+};
+
+// Everything exported by the metrics endpoint. Owned and updated by the
+// control loop, then published whole through a seqlock once per tick.
+struct metrics_snapshot {
+  // Gauges
+  int32_t        cpu_temp;
+  uint32_t       num_devices;
+  uint32_t       failsafe;  // 1 while the watchdog forces full duty
+  double         first_fan_command;  // Seconds after process start, 0 if
+                                     // there was no fast start
+  device_metrics devices[kMaxMetricsDevices];
+  // Counters
+  uint64_t ticks;
+  uint64_t reconnects;
+  uint64_t usb_errors;
+  uint64_t usb_commands_skipped;  // Replaced before the I/O thread sent them
+  uint64_t config_reloads;
+  uint64_t deadline_misses;
+  uint64_t sensor_failures;
+  uint64_t watchdog_reinits;
+  // Histograms
+  latency_histogram tick_duration;
+  latency_histogram usb_round_trip;
+};
+
+using PublishedMetrics = Seqlock<metrics_snapshot>;
+
+// Renders the snapshot in the Prometheus text exposition format
+std::string format_metrics(const metrics_snapshot &metrics);
+
+#endif  // METRICS_H
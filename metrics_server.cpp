@@ -0,0 +1,102 @@
+#include "metrics_server.hpp"
+#include "unix_socket.hpp"
+
+#include <cerrno>
+#include <glog/logging.h>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+MetricsServer::MetricsServer(const std::string &     path,
+                             const PublishedMetrics &metrics)
+  : _path(path)
+  , _metrics(metrics)
+  , _fd(listen_unix_socket(path, 0666))
+  , _stop_fd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+  , _expiry(std::chrono::duration_cast<std::chrono::milliseconds>(
+      kMetricsClientTimeout)) {
+  PCHECK(_stop_fd >= 0) << "Failed to create eventfd";
+  _loop.add(_fd, EPOLLIN, [this](uint32_t) { accept(); });
+  _loop.add(_stop_fd, EPOLLIN, [this](uint32_t) { _loop.stop(); });
+  _loop.add(_expiry.fd(), EPOLLIN, [this](uint32_t) {
+    _expiry.consume();
+    expire();
+  });
+  _thread = std::thread([this]() { _loop.run(); });
+  LOG(INFO) << "Serving metrics on " << path;
+}
+
+MetricsServer::~MetricsServer() {
+  const uint64_t one = 1;
+  if (write(_stop_fd, &one, sizeof(one)) != sizeof(one)) {
+    PLOG(ERROR) << "Failed to signal metrics server shutdown";
+  }
+  _thread.join();
+  for (const auto &client : _clients) {
+    close(client.first);
+  }
+  close(_stop_fd);
+  close(_fd);
+  unlink(_path.c_str());
+}
+
+/** ********** Private interface ********** */
+
+void MetricsServer::accept() {
+  int client;
+  while ((client = accept4(_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC))
+         >= 0) {
+    metrics_snapshot snapshot;
+    if (_clients.size() >= kMaxMetricsClients || !_metrics.load(snapshot)) {
+      close(client);
+      continue;
+    }
+    // The response fits in the socket buffer, so one non-blocking write is
+    // enough. The request itself is never parsed.
+    const std::string body = format_metrics(snapshot);
+    const std::string response =
+      "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+      "Content-Length: "
+      + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    if (send(client, response.data(), response.size(), MSG_NOSIGNAL)
+        != static_cast<ssize_t>(response.size())) {
+      VLOG(1) << "Short write to metrics client";
+    }
+    // Half close and wait for the client to hang up, closing with its request
+    // still unread would reset the connection before it reads the response
+    shutdown(client, SHUT_WR);
+    _clients[client] = std::chrono::steady_clock::now();
+    _loop.add(client, EPOLLIN | EPOLLRDHUP,
+              [this, client](uint32_t) { drain(client); });
+  }
+}
+
+void MetricsServer::drain(int client) {
+  char    buffer[512];
+  ssize_t len;
+  while ((len = read(client, buffer, sizeof(buffer))) > 0) {
+  }
+  if (len == 0 || errno != EAGAIN) {
+    disconnect(client);
+  }
+}
+
+// Clients that never hang up would otherwise hold their fd forever
+void MetricsServer::expire() {
+  const auto now = std::chrono::steady_clock::now();
+  for (auto it = _clients.begin(); it != _clients.end();) {
+    const auto client = *it++;
+    if (now - client.second >= kMetricsClientTimeout) {
+      VLOG(1) << "Dropping idle metrics client";
+      disconnect(client.first);
+    }
+  }
+}
+
+void MetricsServer::disconnect(int client) {
+  _loop.remove(client);
+  close(client);
+  _clients.erase(client);
+}
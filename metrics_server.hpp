@@ -0,0 +1,44 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+#include "event_loop.hpp"
+#include "metrics.hpp"
+
+#define kMaxMetricsClients 16
+#define kMetricsClientTimeout std::chrono::seconds(5)
+
+// Serves the published metrics on a unix domain socket as a minimal HTTP
+// response in the Prometheus text format. Runs its own event loop on a
+// background thread, a scrape only reads the seqlock and never delays a tick.
+// At most kMaxMetricsClients connections are kept, each for at most
+// kMetricsClientTimeout (up to twice that, the sweep runs once a timeout).
+class MetricsServer {
+ public:
+  // Throws std::runtime_error if the socket can't be bound
+  MetricsServer(const std::string &path, const PublishedMetrics &metrics);
+  MetricsServer(const MetricsServer &) = delete;
+  ~MetricsServer();
+
+ private:
+  void accept();
+  void drain(int client);
+  void expire();
+  void disconnect(int client);
+
+  const std::string       _path;
+  const PublishedMetrics &_metrics;
+  int                     _fd;
+  int                     _stop_fd;  // eventfd, wakes the loop for shutdown
+  // Only touched by _thread once it runs
+  EventLoop                                                      _loop;
+  TickTimer                                                      _expiry;
+  std::unordered_map<int, std::chrono::steady_clock::time_point> _clients;
+  std::thread                                                    _thread;
+};
+
+#endif  // METRICS_SERVER_H
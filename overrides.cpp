@@ -0,0 +1,100 @@
+#include "overrides.hpp"
+
+#include <glog/logging.h>
+
+/** ********** OverrideMailbox ********** */
+
+bool OverrideMailbox::post(const override_command &command) {
+  const uint32_t head = _head.load(std::memory_order_relaxed);
+  if (head - _tail.load(std::memory_order_acquire) == kOverrideMailboxSize) {
+    return false;
+  }
+  _commands[head % kOverrideMailboxSize] = command;
+  _head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+bool OverrideMailbox::take(override_command &command) {
+  const uint32_t tail = _tail.load(std::memory_order_relaxed);
+  if (tail == _head.load(std::memory_order_acquire)) {
+    return false;
+  }
+  command = _commands[tail % kOverrideMailboxSize];
+  _tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+/** ********** Overrides ********** */
+
+void Overrides::drain(OverrideMailbox &mailbox, Clock::time_point now) {
+  override_command command;
+  while (mailbox.take(command)) {
+    if (command.clear) {
+      for (size_t i = 0; i < _active.size(); ++i) {
+        if (command.kind == OverrideKind::COUNT
+            || static_cast<size_t>(command.kind) == i) {
+          _active[i].set = false;
+        }
+      }
+      LOG(INFO) << "Cleared " << overrideKindToString(command.kind)
+                << " override";
+      continue;
+    }
+    auto &active   = _active[static_cast<size_t>(command.kind)];
+    active.set     = true;
+    active.value   = command.value;
+    active.expires = now + std::chrono::milliseconds(command.ttl_ms);
+    LOG(INFO) << "Overriding " << overrideKindToString(command.kind)
+              << " with " << command.value << " for " << command.ttl_ms
+              << "ms";
+  }
+}
+
+DutyCycle Overrides::duty(DutyCycle controlled, Clock::time_point now) {
+  live(OverrideKind::FAN, now, controlled.fan);
+  live(OverrideKind::PUMP, now, controlled.pump);
+  return controlled;
+}
+
+uint32_t Overrides::color(uint32_t configured, Clock::time_point now) {
+  live(OverrideKind::COLOR, now, configured);
+  return configured;
+}
+
+TempSource Overrides::tempSource(TempSource configured, Clock::time_point now) {
+  uint32_t source;
+  return live(OverrideKind::TEMP_SOURCE, now, source)
+           ? static_cast<TempSource>(source)
+           : configured;
+}
+
+bool Overrides::live(OverrideKind kind, Clock::time_point now,
+                     uint32_t &value) {
+  auto &active = _active[static_cast<size_t>(kind)];
+  if (!active.set) {
+    return false;
+  }
+  if (now >= active.expires) {
+    LOG(INFO) << overrideKindToString(kind)
+              << " override expired, back to configured value";
+    active.set = false;
+    return false;
+  }
+  value = active.value;
+  return true;
+}
+
+const char *overrideKindToString(OverrideKind kind) {
+  switch (kind) {
+  case OverrideKind::FAN:
+    return "fan";
+  case OverrideKind::PUMP:
+    return "pump";
+  case OverrideKind::COLOR:
+    return "color";
+  case OverrideKind::TEMP_SOURCE:
+    return "source";
+  default:
+    return "all";
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef OVERRIDES_H
+#define OVERRIDES_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include "fan_controller.hpp"
+#include "leviathan_config.hpp"
+
+#define kOverrideMailboxSize 64  // Power of 2
+#define kMaxOverrideTtl 86400    // Seconds
+
+enum class OverrideKind : uint8_t { FAN, PUMP, COLOR, TEMP_SOURCE, COUNT };
+
+// One request from the control socket. A clear command drops the override
+// of that kind, or every override if kind is COUNT.
+struct override_command {
+  OverrideKind kind;
+  bool         clear;
+  uint32_t     value;   // Duty percent, RGB color or TempSource
+  uint32_t     ttl_ms;
+};
+
+// Single producer, single consumer ring of commands. The control socket posts
+// and the control loop drains, neither side ever blocks or allocates.
+class OverrideMailbox {
+ public:
+  // Returns false if the mailbox is full
+  bool post(const override_command &command);
+  // Pops every pending command, returns false once empty
+  bool take(override_command &command);
+
+ private:
+  std::array<override_command, kOverrideMailboxSize> _commands;
+  alignas(64) std::atomic<uint32_t> _head{0};  // Next slot to write
+  alignas(64) std::atomic<uint32_t> _tail{0};  // Next slot to read
+};
+
+// Overrides currently in effect, owned by the control loop. Every accessor
+// falls back to the configured value once an override's TTL has elapsed.
+class Overrides {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Applies everything posted since the last tick
+  void drain(OverrideMailbox &mailbox, Clock::time_point now);
+
+  DutyCycle  duty(DutyCycle controlled, Clock::time_point now);
+  uint32_t   color(uint32_t configured, Clock::time_point now);
+  TempSource tempSource(TempSource configured, Clock::time_point now);
+
+ private:
+  struct active_override {
+    bool              set{false};
+    uint32_t          value{0};
+    Clock::time_point expires;
+  };
+
+  // Returns the override value if it's still live, expiring it otherwise
+  bool live(OverrideKind kind, Clock::time_point now, uint32_t &value);
+
+  std::array<active_override, static_cast<size_t>(OverrideKind::COUNT)>
+    _active;
+};
+
+const char *overrideKindToString(OverrideKind kind);
+
+#endif  // OVERRIDES_H
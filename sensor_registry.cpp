@@ -0,0 +1,61 @@
+#include "sensor_registry.hpp"
+#include "hwmon_temperature_monitor.hpp"
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <limits>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Inputs live in the hwmon directory, or on the underlying device with
+// older kernels
+int open_hwmon_input(const std::string &dir, uint32_t input) {
+  const std::string file = "temp" + std::to_string(input) + "_input";
+  int fd = open((dir + "/" + file).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fd = open((dir + "/device/" + file).c_str(), O_RDONLY | O_CLOEXEC);
+  }
+  return fd;
+}
+
+SensorRegistry::SensorRegistry(const std::vector<hwmon_sensor> &sensors,
+                               const char *const                root)
+  : _sensors(sensors) {
+  if (_sensors.empty()) {
+    return;
+  }
+  const auto chips = list_hwmon_chips(root);
+  for (const auto &sensor : _sensors) {
+    const auto chip = std::find_if(
+      chips.begin(), chips.end(),
+      [&sensor](const auto &c) { return c.first == sensor.chip_; });
+    const int fd = chip == chips.end()
+                     ? -1
+                     : open_hwmon_input(chip->second, sensor.input_);
+    if (fd < 0) {
+      for (const int open_fd : _fds) {
+        close(open_fd);
+      }
+      throw std::runtime_error("Unable to open sensor " + sensor.name_
+                               + ", hwmon chip " + sensor.chip_ + " temp"
+                               + std::to_string(sensor.input_) + "_input");
+    }
+    LOG(INFO) << "Sensor " << sensor.name_ << " reads " << sensor.chip_
+              << " temp" << sensor.input_ << "_input at " << chip->second;
+    _fds.push_back(fd);
+  }
+}
+
+SensorRegistry::~SensorRegistry() {
+  for (const int fd : _fds) {
+    close(fd);
+  }
+}
+
+void SensorRegistry::sample(int32_t *temps) const {
+  for (size_t i = 0; i < _fds.size(); ++i) {
+    temps[kFirstHwmonSource + i] = read_hwmon_temperature(_fds[i]);
+  }
+}
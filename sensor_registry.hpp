@@ -0,0 +1,31 @@
+#ifndef SENSOR_REGISTRY_H
+#define SENSOR_REGISTRY_H
+
+#include <cstdint>
+#include <vector>
+
+#include "constants.h"
+#include "leviathan_config.hpp"
+
+// Opens the hwmon sensors of the config once, so sampling all of them is a
+// pread per sensor into the slots after the CPU and liquid temperatures
+class SensorRegistry {
+ public:
+  // Throws std::runtime_error if a chip or input is missing
+  explicit SensorRegistry(const std::vector<hwmon_sensor> &sensors,
+                          const char *const root = kDefaultHwmonDir);
+  SensorRegistry(const SensorRegistry &) = delete;
+  ~SensorRegistry();
+
+  // Writes every sensor to temps[kFirstHwmonSource + i], a failed read as
+  // std::numeric_limits<int>::min()
+  void sample(int32_t *temps) const;
+
+  const std::vector<hwmon_sensor> &sensors() const { return _sensors; }
+
+ private:
+  std::vector<hwmon_sensor> _sensors;
+  std::vector<int>          _fds;
+};
+
+#endif  // SENSOR_REGISTRY_H
@@ -0,0 +1,55 @@
+#ifndef SEQLOCK_H
+#define SEQLOCK_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#define kSeqlockReadAttempts 1024
+
+// Single writer, many reader sequence lock around a trivially copyable value.
+// Writers never wait and readers never write, so it also works across
+// processes when placed in shared memory.
+template <class T>
+class Seqlock {
+  static_assert(std::is_trivially_copyable<T>::value,
+                "Seqlock values are copied with memcpy");
+
+ public:
+  void store(const T &value) {
+    const uint32_t seq = _seq.load(std::memory_order_relaxed);
+    _seq.store(seq + 1, std::memory_order_relaxed);  // Odd, write in progress
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(&_value, &value, sizeof(T));
+    _seq.store(seq + 2, std::memory_order_release);
+  }
+
+  // Returns false if no consistent copy could be taken, e.g. the writer died
+  // mid update and left the sequence odd
+  bool load(T &out, unsigned attempts = kSeqlockReadAttempts) const {
+    while (attempts-- > 0) {
+      const uint32_t before = _seq.load(std::memory_order_acquire);
+      if (before & 1) {
+        continue;
+      }
+      memcpy(&out, &_value, sizeof(T));
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (_seq.load(std::memory_order_relaxed) == before) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Number of completed stores
+  uint32_t version() const {
+    return _seq.load(std::memory_order_acquire) / 2;
+  }
+
+ private:
+  std::atomic<uint32_t> _seq{0};
+  T                     _value{};
+};
+
+#endif  // SEQLOCK_H
@@ -0,0 +1,75 @@
+#include "session_trace.hpp"
+#include "tick_trace.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <glog/logging.h>
+#include <stdexcept>
+#include <time.h>
+
+#define kSessionBufferSize (1 << 20)
+
+std::runtime_error session_error(const std::string &what,
+                                 const std::string &path) {
+  return std::runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+/** ********** SessionRecorder ********** */
+
+SessionRecorder::SessionRecorder(const std::string &path)
+  : _file(fopen(path.c_str(), "we")) {
+  if (_file == NULL) {
+    throw session_error("Unable to create", path);
+  }
+  setvbuf(_file, NULL, _IOFBF, kSessionBufferSize);
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  const session_header header = {kSessionMagic, kSessionVersion,
+                                 ts.tv_sec * 1000000000ull + ts.tv_nsec};
+  if (fwrite(&header, sizeof(header), 1, _file) != 1) {
+    fclose(_file);
+    throw session_error("Unable to write", path);
+  }
+}
+
+SessionRecorder::~SessionRecorder() {
+  PLOG_IF(ERROR, fclose(_file) != 0) << "Failed to finish session capture";
+}
+
+void SessionRecorder::record(SessionRecord type,
+                             uint8_t       device,
+                             const void *  payload,
+                             size_t        length) {
+  length = std::min<size_t>(length, kMaxSessionPayload);
+  unsigned char buffer[sizeof(session_record_header) + kMaxSessionPayload];
+  const session_record_header header = {
+    monotonic_ns(), type, device, static_cast<uint16_t>(length), 0};
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), payload, length);
+  fwrite(buffer, sizeof(header) + length, 1, _file);
+}
+
+/** ********** SessionReader ********** */
+
+SessionReader::SessionReader(const std::string &path)
+  : _file(fopen(path.c_str(), "re")) {
+  if (_file == NULL) {
+    throw session_error("Unable to open", path);
+  }
+  if (fread(&_header, sizeof(_header), 1, _file) != 1
+      || _header.magic != kSessionMagic
+      || _header.version != kSessionVersion) {
+    fclose(_file);
+    throw std::runtime_error(path + " is not a levd session capture");
+  }
+}
+
+SessionReader::~SessionReader() { fclose(_file); }
+
+bool SessionReader::next(session_record_header &record,
+                         unsigned char *        payload) {
+  return fread(&record, sizeof(record), 1, _file) == 1
+         && record.length <= kMaxSessionPayload
+         && fread(payload, 1, record.length, _file) == record.length;
+}
@@ -0,0 +1,91 @@
+#ifndef SESSION_TRACE_H
+#define SESSION_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "leviathan_config.hpp"
+
+#define kSessionMagic 0x5356454c  // "LEVS"
+#define kSessionVersion 1
+#define kMaxSessionPayload 64  // Largest usb frame
+
+// Starts the file, records follow directly after
+struct session_header {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t start_ns;  // CLOCK_REALTIME when the capture started
+};
+
+enum class SessionRecord : uint8_t {
+  DEVICE = 1,   // Serial number of the device index, on every (re)connect
+  TICK,         // session_tick
+  USB_CONTROL,  // wValue of a control transfer, 2 bytes
+  USB_OUT,      // Bulk out frame as sent
+  USB_IN        // 32 byte status frame as received
+};
+
+// Precedes every record, length bytes of payload follow
+struct session_record_header {
+  uint64_t      timestamp_ns;  // CLOCK_MONOTONIC
+  SessionRecord type;
+  uint8_t       device;
+  uint16_t      length;
+  uint32_t      reserved;
+};
+static_assert(sizeof(session_record_header) == 16,
+              "session_record_header is on disk");
+
+#define kSessionForced 0x01  // Duty set by an override or the failsafe
+
+// One device in one control tick
+struct session_tick {
+  int32_t  sources[kMaxTempSources];  // Slots, see kCpuSource
+  uint32_t control_temp;
+  uint8_t  temp_source;  // TempSource in effect
+  uint8_t  fan_duty;
+  uint8_t  pump_duty;
+  uint8_t  flags;
+};
+static_assert(sizeof(session_tick) == 40, "session_tick is on disk");
+
+// Appends records to a capture file through a stdio buffer. Each record is
+// written with a single fwrite, so the control loop and the usb I/O threads
+// can record concurrently without interleaving.
+class SessionRecorder {
+ public:
+  // Throws std::runtime_error if the file can't be created
+  explicit SessionRecorder(const std::string &path);
+  SessionRecorder(const SessionRecorder &) = delete;
+  ~SessionRecorder();
+
+  void record(SessionRecord type,
+              uint8_t       device,
+              const void *  payload,
+              size_t        length);
+
+ private:
+  FILE *_file;
+};
+
+// Reads a capture file front to back
+class SessionReader {
+ public:
+  // Throws std::runtime_error if the file can't be opened or isn't a capture
+  explicit SessionReader(const std::string &path);
+  SessionReader(const SessionReader &) = delete;
+  ~SessionReader();
+
+  const session_header &header() const { return _header; }
+  // Fills the next record, payload must hold kMaxSessionPayload bytes.
+  // Returns false at the end of the file or on a truncated record.
+  bool next(session_record_header &record, unsigned char *payload);
+
+ private:
+  FILE *         _file;
+  session_header _header;
+};
+
+#endif  // SESSION_TRACE_H
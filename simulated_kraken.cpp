@@ -0,0 +1,299 @@
+#include "simulated_kraken.hpp"
+#include "constants.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glog/logging.h>
+#include <string.h>
+#include <thread>
+
+#define kMaxModelStep 0.1  // s
+#define kSimulatedCores 8
+
+/** ********** ThermalModel ********** */
+
+ThermalModel::ThermalModel(const simulation_config &config)
+  : _config(config)
+  , _last_update(std::chrono::steady_clock::now())
+  , _liquid_temp(config.ambient_) {}
+
+void ThermalModel::setDuty(uint32_t fan, uint32_t pump) {
+  std::lock_guard<std::mutex> guard(_lock);
+  advance();
+  _fan_duty  = fan;
+  _pump_duty = pump;
+}
+
+double ThermalModel::cpuTemperature() {
+  std::lock_guard<std::mutex> guard(_lock);
+  advance();
+  return _liquid_temp + heatLoad() * _config.cold_plate_resistance_;
+}
+
+double ThermalModel::liquidTemperature() {
+  std::lock_guard<std::mutex> guard(_lock);
+  advance();
+  return _liquid_temp;
+}
+
+double ThermalModel::fanRpm() {
+  std::lock_guard<std::mutex> guard(_lock);
+  advance();
+  return _fan_rpm;
+}
+
+double ThermalModel::pumpRpm() {
+  std::lock_guard<std::mutex> guard(_lock);
+  advance();
+  return _pump_rpm;
+}
+
+void ThermalModel::advance() {
+  const auto   now = std::chrono::steady_clock::now();
+  const double elapsed =
+    std::chrono::duration<double>(now - _last_update).count()
+    * _config.time_scale_;
+  _last_update = now;
+
+  const double fan_target  = _config.fan_max_rpm_ * _fan_duty / 100.0;
+  const double pump_target = _config.pump_max_rpm_ * _pump_duty / 100.0;
+  for (double left = elapsed; left > 0; left -= kMaxModelStep) {
+    const double dt = std::min(left, kMaxModelStep);
+    _model_time += dt;
+
+    // Fans and pump approach their target speed exponentially
+    const double spin = 1.0 - std::exp(-dt / _config.spin_time_constant_);
+    _fan_rpm += (fan_target - _fan_rpm) * spin;
+    _pump_rpm += (pump_target - _pump_rpm) * spin;
+
+    // Radiator conductance grows with airflow, a slow pump limits it
+    const double airflow = _fan_rpm / _config.fan_max_rpm_;
+    const double flow    = 0.5 + 0.5 * _pump_rpm / _config.pump_max_rpm_;
+    const double conductance =
+      _config.min_conductance_
+      + (_config.max_conductance_ - _config.min_conductance_) * airflow * flow;
+    _liquid_temp +=
+      (heatLoad() - conductance * (_liquid_temp - _config.ambient_)) * dt
+      / _config.liquid_capacity_;
+  }
+}
+
+double ThermalModel::heatLoad() const {
+  if (_config.load_period_ <= 0) {
+    return _config.heat_load_;
+  }
+  const double phase = std::fmod(_model_time, _config.load_period_);
+  return phase < _config.load_period_ / 2 ? _config.heat_load_
+                                          : _config.idle_load_;
+}
+
+/** ********** SimulatedKraken ********** */
+
+SimulatedKraken::SimulatedKraken(std::shared_ptr<ThermalModel> model,
+                                 const simulation_config &     config,
+                                 const std::string &           serial)
+  : _model(std::move(model))
+  , _config(config)
+  , _serial(serial)
+  , _rng(config.seed_ + std::hash<std::string>()(serial)) {}
+
+bool SimulatedKraken::control(uint16_t value) {
+  std::this_thread::sleep_for(latency());
+  return handleControl(value);
+}
+
+bool SimulatedKraken::bulkOut(const unsigned char *data, const size_t length) {
+  std::this_thread::sleep_for(latency());
+  return handleBulkOut(data, length);
+}
+
+bool SimulatedKraken::bulkIn(unsigned char *data, const size_t length) {
+  std::this_thread::sleep_for(latency());
+  return handleBulkIn(data, length);
+}
+
+bool SimulatedKraken::handleControl(uint16_t value) {
+  if (fault()) {
+    return false;
+  }
+  switch (value) {
+  case KRAKEN_INIT:
+    _initialized = true;
+    return true;
+  case KRAKEN_BEGIN:
+    if (!_initialized) {
+      LOG(ERROR) << _serial << ": BEGIN before INIT";
+      return false;
+    }
+    _begun = true;
+    return true;
+  default:
+    LOG(ERROR) << _serial << ": unknown control value " << value;
+    return false;
+  }
+}
+
+bool SimulatedKraken::handleBulkOut(const unsigned char *data,
+                                    const size_t         length) {
+  if (fault()) {
+    return false;
+  }
+  if (!_begun || length == 0) {
+    LOG(ERROR) << _serial << ": packet sent without BEGIN";
+    return false;
+  }
+  switch (data[0]) {
+  case KRAKEN_COLOR_CODE:
+    if (length != sizeof(kDefaultColor)) {
+      break;
+    }
+    _color = data[1] << 16 | data[2] << 8 | data[3];
+    return true;
+  case KRAKEN_FAN_CODE:
+  case KRAKEN_PUMP_CODE: {
+    if (length != 2 || data[1] < 30 || data[1] > 100) {
+      break;
+    }
+    // The pump packet is always sent right before the fan packet
+    if (data[0] == KRAKEN_PUMP_CODE) {
+      _pump_duty = data[1];
+    } else {
+      _model->setDuty(data[1], _pump_duty);
+    }
+    return true;
+  }
+  }
+  LOG(ERROR) << _serial << ": malformed packet 0x" << std::hex
+             << static_cast<uint32_t>(data[0]) << " of " << std::dec << length
+             << " bytes";
+  return false;
+}
+
+bool SimulatedKraken::handleBulkIn(unsigned char *data, const size_t length) {
+  if (fault()) {
+    return false;
+  }
+  if (length != 32) {
+    LOG(ERROR) << _serial << ": status frames are 32 bytes, not " << length;
+    return false;
+  }
+  _begun                  = false;
+  const uint32_t fan_rpm  = std::lround(_model->fanRpm());
+  const uint32_t pump_rpm = std::lround(_model->pumpRpm());
+  memset(data, 0, length);
+  data[0]  = fan_rpm >> 8;
+  data[1]  = fan_rpm & 0xFF;
+  data[8]  = pump_rpm >> 8;
+  data[9]  = pump_rpm & 0xFF;
+  data[10] = std::lround(_model->liquidTemperature());
+  return true;
+}
+
+bool SimulatedKraken::fault() {
+  return _config.fault_rate_ > 0
+         && std::uniform_real_distribution<double>(0, 1)(_rng)
+              < _config.fault_rate_;
+}
+
+std::chrono::microseconds SimulatedKraken::latency() const {
+  return std::chrono::microseconds(
+    std::lround(_config.latency_us_ / _config.time_scale_));
+}
+
+/** ********** SimulatedKraken::Batch ********** */
+
+void SimulatedKraken::Batch::clear() {
+  CHECK(_state != State::IN_FLIGHT) << "Cannot modify a batch in flight";
+  _steps.clear();
+}
+
+void SimulatedKraken::Batch::addControl(uint16_t value) {
+  _steps.push_back({Kind::CONTROL, value, 0, {}});
+}
+
+void SimulatedKraken::Batch::addBulkOut(const unsigned char *data,
+                                        const size_t         length) {
+  CHECK(length <= sizeof(step::data)) << "Bulk payload too large: " << length;
+  step out = {Kind::BULK_OUT, 0, length, {}};
+  memcpy(out.data, data, length);
+  _steps.push_back(out);
+}
+
+void SimulatedKraken::Batch::addBulkIn(const size_t length) {
+  CHECK(length <= sizeof(step::data)) << "Bulk read too large: " << length;
+  _steps.push_back({Kind::BULK_IN, 0, length, {}});
+}
+
+bool SimulatedKraken::Batch::submit() {
+  if (_state == State::IN_FLIGHT || _steps.empty()) {
+    return false;
+  }
+  // Latency is injected by the completion time instead of sleeping, the
+  // device itself answers right away
+  const auto latency = _device.latency();
+  const auto start   = std::chrono::steady_clock::now();
+  _failed            = false;
+  for (auto &s : _steps) {
+    bool ok = false;
+    switch (s.kind) {
+    case Kind::CONTROL:
+      ok = _device.handleControl(s.value);
+      break;
+    case Kind::BULK_OUT:
+      ok = _device.handleBulkOut(s.data, s.length);
+      break;
+    case Kind::BULK_IN:
+      ok = _device.handleBulkIn(s.data, s.length);
+      if (ok) {
+        memcpy(_last_read, s.data, s.length);
+      }
+      break;
+    }
+    if (!ok) {
+      _failed = true;
+      break;
+    }
+  }
+  _round_trip = latency * _steps.size();
+  _done       = start + _round_trip;
+  _state      = State::IN_FLIGHT;
+  return true;
+}
+
+TransferBatch::State SimulatedKraken::Batch::poll() {
+  if (_state == State::IN_FLIGHT && std::chrono::steady_clock::now() >= _done) {
+    _state = _failed ? State::FAILED : State::COMPLETED;
+  }
+  const State state = _state;
+  if (state == State::COMPLETED || state == State::FAILED) {
+    _state = State::IDLE;
+  }
+  return state;
+}
+
+/** ********** SimulatedTemperatureMonitor ********** */
+
+uint32_t SimulatedTemperatureMonitor::getPackageIdTemperature() const {
+  return std::lround(_model->cpuTemperature());
+}
+
+uint32_t SimulatedTemperatureMonitor::getCoreIdTemperature(
+  uint8_t core_id) const {
+  // Cores sit a little above or below the package, the same way every time
+  return std::lround(_model->cpuTemperature() + (core_id % 4) - 1.5);
+}
+
+size_t SimulatedTemperatureMonitor::coreCount() const {
+  return kSimulatedCores;
+}
+
+size_t SimulatedTemperatureMonitor::sampleCoreTemperatures(
+  int32_t *out,
+  size_t   capacity) const {
+  const double package = _model->cpuTemperature();
+  const size_t n       = std::min<size_t>(capacity, kSimulatedCores);
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = std::lround(package + (i % 4) - 1.5);
+  }
+  return n;
+}
@@ -0,0 +1,144 @@
+#ifndef SIMULATED_KRAKEN_H
+#define SIMULATED_KRAKEN_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "kraken_transport.hpp"
+#include "simulation_config.hpp"
+#include "temperature_monitor.hpp"
+
+// Lumped thermal model of CPU, cold plate, coolant and radiator. Advances with
+// the real clock scaled by time_scale_, so the daemon can be run faster than
+// real time. Shared by the simulated device and the simulated CPU sensor.
+class ThermalModel {
+ public:
+  explicit ThermalModel(const simulation_config &config);
+
+  void setDuty(uint32_t fan, uint32_t pump);
+
+  double cpuTemperature();
+  double liquidTemperature();
+  double fanRpm();
+  double pumpRpm();
+
+ private:
+  // Integrates up to now, in steps short enough to stay stable
+  void advance();
+  double heatLoad() const;
+
+  const simulation_config _config;
+  std::mutex              _lock;  // Sensor reads may come from other threads
+
+  std::chrono::steady_clock::time_point _last_update;
+  double                                _model_time{0.0};  // s
+  double                                _liquid_temp;
+  double                                _fan_rpm{0.0};
+  double                                _pump_rpm{0.0};
+  uint32_t                              _fan_duty{30};
+  uint32_t                              _pump_duty{30};
+};
+
+// In process stand-in for the X61. Validates the protocol the way the device
+// expects it (INIT before anything else, BEGIN before every packet sequence,
+// well formed 0x10/0x12/0x13 packets, 32 byte status reads) and answers with
+// status frames from the thermal model.
+class SimulatedKraken : public KrakenTransport {
+ public:
+  SimulatedKraken(std::shared_ptr<ThermalModel> model,
+                  const simulation_config &     config,
+                  const std::string &           serial);
+  SimulatedKraken(const SimulatedKraken &) = delete;
+
+  std::string serialNumber() override { return _serial; }
+
+  bool control(uint16_t value) override;
+  bool bulkOut(const unsigned char *data, const size_t length) override;
+  bool bulkIn(unsigned char *data, const size_t length) override;
+
+  TransferBatch &batch() override { return _batch; }
+
+ private:
+  // Batch run against the device on submit, reported complete once the
+  // injected latency of all its steps has elapsed
+  class Batch : public TransferBatch {
+   public:
+    explicit Batch(SimulatedKraken &device) : _device(device) {}
+
+    void clear() override;
+    void addControl(uint16_t value) override;
+    void addBulkOut(const unsigned char *data, const size_t length) override;
+    void addBulkIn(const size_t length) override;
+
+    bool  submit() override;
+    State poll() override;
+    // Until poll() has seen the batch finish
+    bool  inFlight() const override { return _state == State::IN_FLIGHT; }
+    const unsigned char *lastRead() const override { return _last_read; }
+    std::chrono::steady_clock::duration roundTrip() const override {
+      return _round_trip;
+    }
+
+   private:
+    enum class Kind { CONTROL, BULK_OUT, BULK_IN };
+    struct step {
+      Kind          kind;
+      uint16_t      value;
+      size_t        length;
+      unsigned char data[64];
+    };
+
+    SimulatedKraken &                     _device;
+    std::vector<step>                     _steps;
+    State                                 _state{State::IDLE};
+    bool                                  _failed{false};
+    std::chrono::steady_clock::time_point _done;
+    std::chrono::steady_clock::duration   _round_trip{0};
+    unsigned char                         _last_read[64]{};
+  };
+
+  // The device side of each transfer, without the injected latency
+  bool handleControl(uint16_t value);
+  bool handleBulkOut(const unsigned char *data, const size_t length);
+  bool handleBulkIn(unsigned char *data, const size_t length);
+
+  // Rolls for an injected fault
+  bool fault();
+  // Real time the injected latency takes
+  std::chrono::microseconds latency() const;
+
+  const std::shared_ptr<ThermalModel> _model;
+  const simulation_config             _config;
+  const std::string                   _serial;
+  std::mt19937                        _rng;
+  bool                                _initialized{false};
+  bool                                _begun{false};
+  uint32_t                            _color{0};
+  uint32_t _pump_duty{30};  // Applied together with the fan packet
+  Batch                               _batch{*this};
+};
+
+// CPU sensor reading the thermal model, with a fixed spread between cores
+class SimulatedTemperatureMonitor : public TemperatureMonitor {
+ public:
+  explicit SimulatedTemperatureMonitor(std::shared_ptr<ThermalModel> model)
+    : _model(std::move(model)) {}
+
+  uint32_t getPackageIdTemperature() const override;
+  uint32_t getCoreIdTemperature(uint8_t core_id) const override;
+  size_t   coreCount() const override;
+  size_t   sampleCoreTemperatures(int32_t *out,
+                                  size_t   capacity) const override;
+
+ private:
+  const std::shared_ptr<ThermalModel> _model;
+};
+
+#endif  // SIMULATED_KRAKEN_H
@@ -0,0 +1,35 @@
+#ifndef SIMULATION_CONFIG_H
+#define SIMULATION_CONFIG_H
+
+#include <cstdint>
+
+// Parameters of the simulation, the simulation config section
+struct simulation_config {
+  uint32_t devices_{1};
+
+  // Workload, heat_load_ while busy, idle_load_ otherwise. A load_period_ of
+  // 0 keeps the CPU busy, otherwise it alternates every half period.
+  double heat_load_{150.0};  // W
+  double idle_load_{20.0};   // W
+  double load_period_{0.0};  // s
+
+  // Cooling loop
+  double ambient_{25.0};               // C
+  double liquid_capacity_{1500.0};     // J/K, coolant plus block
+  double cold_plate_resistance_{0.15}; // K/W, CPU above coolant per watt
+  double min_conductance_{4.0};        // W/K, radiator with fans stopped
+  double max_conductance_{30.0};       // W/K, radiator at full fan speed
+  double fan_max_rpm_{2000.0};
+  double pump_max_rpm_{2900.0};
+  double spin_time_constant_{1.5};  // s, fan/pump response to a new duty
+
+  // Model seconds per real second, > 1 runs faster than real time
+  double time_scale_{1.0};
+
+  // Injected faults
+  uint32_t latency_us_{1000};  // Per transfer
+  double   fault_rate_{0.0};   // Probability of a transfer failing
+  uint32_t seed_{1};
+};
+
+#endif  // SIMULATION_CONFIG_H
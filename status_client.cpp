@@ -0,0 +1,42 @@
+#include "status_client.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+StatusClient::StatusClient(const char *const name) {
+  const int fd = shm_open(name, O_RDONLY | O_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("Unable to open ") + name
+                             + ", is levd running? " + strerror(errno));
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0
+      || static_cast<size_t>(st.st_size) < sizeof(status_segment)) {
+    close(fd);
+    throw std::runtime_error(std::string("Unexpected size of ") + name);
+  }
+  void *const map =
+    mmap(NULL, sizeof(status_segment), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error(std::string("Unable to map ") + name + ": "
+                             + strerror(errno));
+  }
+  _segment = static_cast<const status_segment *>(map);
+  if (_segment->magic != kStatusPageMagic
+      || _segment->version != kStatusPageVersion) {
+    munmap(map, sizeof(status_segment));
+    throw std::runtime_error(std::string("Incompatible status page ") + name);
+  }
+}
+
+StatusClient::~StatusClient() {
+  munmap(const_cast<status_segment *>(_segment), sizeof(status_segment));
+}
@@ -0,0 +1,26 @@
+#ifndef STATUS_CLIENT_H
+#define STATUS_CLIENT_H
+
+#include "constants.h"
+#include "status_page.hpp"
+
+// Reader side of the daemon's status page. Once opened, reads are plain
+// loads from shared memory, cheap enough to poll at any frequency.
+class StatusClient {
+ public:
+  // Throws std::runtime_error if the daemon isn't running
+  explicit StatusClient(const char *const name = kDefaultStatusShm);
+  StatusClient(const StatusClient &) = delete;
+  ~StatusClient();
+
+  // False if no consistent snapshot could be taken
+  bool read(levd_status &out) const { return _segment->status.load(out); }
+  // Number of updates published so far, changes whenever read() would
+  uint32_t version() const { return _segment->status.version(); }
+  int32_t  pid() const { return _segment->pid; }
+
+ private:
+  const status_segment *_segment;
+};
+
+#endif  // STATUS_CLIENT_H
@@ -0,0 +1,42 @@
+#include "status_page.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+StatusPage::StatusPage(const char *const name) : _name(name) {
+  const int fd = shm_open(name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw std::runtime_error("Unable to open shared memory " + _name + ": "
+                             + strerror(errno));
+  }
+  if (ftruncate(fd, sizeof(status_segment)) != 0) {
+    close(fd);
+    throw std::runtime_error("Unable to size shared memory " + _name + ": "
+                             + strerror(errno));
+  }
+  void *const map = mmap(NULL, sizeof(status_segment), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw std::runtime_error("Unable to map shared memory " + _name + ": "
+                             + strerror(errno));
+  }
+  // Always start from a fresh segment, a previous instance may have died
+  // halfway through an update
+  _segment          = new (map) status_segment();
+  _segment->magic   = kStatusPageMagic;
+  _segment->version = kStatusPageVersion;
+  _segment->pid     = getpid();
+}
+
+StatusPage::~StatusPage() {
+  // Readers treat a missing segment as the daemon not running
+  munmap(_segment, sizeof(status_segment));
+  shm_unlink(_name.c_str());
+}
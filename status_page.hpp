@@ -0,0 +1,64 @@
+#ifndef STATUS_PAGE_H
+#define STATUS_PAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "constants.h"
+#include "seqlock.hpp"
+
+#define kStatusPageMagic 0x5453564c  // "LVST"
+#define kStatusPageVersion 1
+
+// Latest state of the daemon, republished every tick
+struct levd_status {
+  uint64_t updated_ns;  // CLOCK_REALTIME of the last tick
+  uint64_t ticks;
+  char     serial[32];  // NUL terminated Kraken serial number
+  int32_t  cpu_temp;    // C
+  int32_t  liquid_temp; // C
+  uint32_t fan_rpm;
+  uint32_t pump_rpm;
+  uint32_t color;
+  uint8_t  fan_duty;   // Percent
+  uint8_t  pump_duty;  // Percent
+  uint8_t  connected;  // 0 while the Kraken is unplugged or unresponsive
+  uint8_t  reserved[1];
+};
+
+// Segment of the Kraken at the given index, the first one keeps the
+// historical name so existing readers keep working. Simulated Krakens get
+// segments of their own, a simulation must not replace a running daemon's.
+inline std::string status_page_name(size_t device, bool simulated = false) {
+  const std::string prefix =
+    simulated ? kSimulatedStatusShm : kDefaultStatusShm;
+  return device == 0 ? prefix : prefix + "_" + std::to_string(device);
+}
+
+// Layout of the shared memory segment, shared with status_client
+struct status_segment {
+  uint32_t             magic;
+  uint32_t             version;
+  int32_t              pid;  // Of the daemon that owns the segment
+  uint32_t             reserved;
+  Seqlock<levd_status> status;
+};
+
+// Writer side, owned by the daemon. Creates the segment under /dev/shm and
+// publishes through the seqlock so readers never see a torn status.
+class StatusPage {
+ public:
+  // Throws std::runtime_error if the segment can't be created
+  explicit StatusPage(const char *const name);
+  StatusPage(const StatusPage &) = delete;
+  ~StatusPage();
+
+  void publish(const levd_status &status) { _segment->status.store(status); }
+
+ private:
+  const std::string _name;
+  status_segment *  _segment;
+};
+
+#endif  // STATUS_PAGE_H
@@ -0,0 +1,124 @@
+#include "telemetry_ring.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+std::runtime_error telemetry_error(const std::string &what,
+                                   const std::string &path) {
+  return std::runtime_error(what + " " + path + ": " + strerror(errno));
+}
+
+/** ********** TelemetryRing ********** */
+
+TelemetryRing::TelemetryRing(const std::string &path, uint32_t capacity)
+  : _path(path)
+  , _length(sizeof(telemetry_header) + capacity * sizeof(telemetry_record)) {
+  if (capacity == 0) {
+    throw std::runtime_error("Telemetry capacity must be greater than 0");
+  }
+  const auto slash = path.find_last_of('/');
+  if (slash != std::string::npos && slash > 0) {
+    // Parent is usually /var/lib/leviathan, created on first run
+    mkdir(path.substr(0, slash).c_str(), 0755);
+  }
+  const int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (fd < 0) {
+    throw telemetry_error("Unable to open", path);
+  }
+  if (ftruncate(fd, _length) != 0) {
+    close(fd);
+    throw telemetry_error("Unable to size", path);
+  }
+  void *const map =
+    mmap(NULL, _length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw telemetry_error("Unable to map", path);
+  }
+  _header  = static_cast<telemetry_header *>(map);
+  _records = reinterpret_cast<telemetry_record *>(_header + 1);
+
+  if (_header->magic != kTelemetryMagic
+      || _header->version != kTelemetryVersion
+      || _header->record_size != sizeof(telemetry_record)
+      || _header->capacity != capacity) {
+    // New file or different layout, history can't be reused
+    memset(map, 0, _length);
+    _header->magic       = kTelemetryMagic;
+    _header->version     = kTelemetryVersion;
+    _header->record_size = sizeof(telemetry_record);
+    _header->capacity    = capacity;
+    _header->write_index.store(0, std::memory_order_release);
+  }
+}
+
+TelemetryRing::~TelemetryRing() { munmap(_header, _length); }
+
+void TelemetryRing::append(const telemetry_record &record) {
+  // Only this process writes, relaxed is enough to read our own index
+  const uint64_t index = _header->write_index.load(std::memory_order_relaxed);
+  // Orders the previous index store before the slot is overwritten, as in
+  // Seqlock::store. A reader that sees any of the new bytes then also sees
+  // the index that makes its check fail.
+  std::atomic_thread_fence(std::memory_order_release);
+  _records[index % _header->capacity] = record;
+  _header->write_index.store(index + 1, std::memory_order_release);
+}
+
+/** ********** TelemetryReader ********** */
+
+TelemetryReader::TelemetryReader(const std::string &path) {
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw telemetry_error("Unable to open", path);
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0
+      || static_cast<size_t>(st.st_size) < sizeof(telemetry_header)) {
+    close(fd);
+    throw std::runtime_error("Not a telemetry file: " + path);
+  }
+  _length        = st.st_size;
+  void *const map = mmap(NULL, _length, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    throw telemetry_error("Unable to map", path);
+  }
+  _header  = static_cast<const telemetry_header *>(map);
+  _records = reinterpret_cast<const telemetry_record *>(_header + 1);
+  if (_header->magic != kTelemetryMagic
+      || _header->version != kTelemetryVersion
+      || _header->record_size != sizeof(telemetry_record)
+      || _length < sizeof(telemetry_header)
+                     + _header->capacity * sizeof(telemetry_record)) {
+    munmap(map, _length);
+    throw std::runtime_error("Incompatible telemetry file: " + path);
+  }
+}
+
+TelemetryReader::~TelemetryReader() {
+  munmap(const_cast<telemetry_header *>(_header), _length);
+}
+
+uint64_t TelemetryReader::firstIndex() const {
+  // The very oldest slot is the next one to be written, skip it
+  const uint64_t end = writeIndex();
+  return end >= capacity() ? end - capacity() + 1 : 0;
+}
+
+bool TelemetryReader::read(uint64_t index, telemetry_record &out) const {
+  if (index >= writeIndex()) {
+    return false;
+  }
+  memcpy(&out, &_records[index % capacity()], sizeof(out));
+  std::atomic_thread_fence(std::memory_order_acquire);
+  // Slot index is rewritten once write_index reaches index + capacity, if
+  // that happened while copying the record may be torn
+  return writeIndex() - index < capacity();
+}
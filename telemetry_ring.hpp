@@ -0,0 +1,85 @@
+#ifndef TELEMETRY_RING_H
+#define TELEMETRY_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define kTelemetryMagic 0x5456454c  // "LEVT"
+#define kTelemetryVersion 1
+
+// One control tick, fixed size so the file is a plain array of them
+struct telemetry_record {
+  uint64_t timestamp_ns;  // CLOCK_REALTIME, meaningful across restarts
+  int32_t  cpu_temp;      // C
+  int32_t  liquid_temp;   // C
+  uint32_t fan_rpm;
+  uint32_t pump_rpm;
+  uint8_t  fan_duty;   // Percent
+  uint8_t  pump_duty;  // Percent
+  uint8_t  device;     // Index of the Kraken, in detection order
+  uint8_t  reserved[5];
+};
+static_assert(sizeof(telemetry_record) == 32, "telemetry_record is on disk");
+
+// Starts the file, records follow directly after
+struct alignas(64) telemetry_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t record_size;
+  uint32_t capacity;
+  // Total records ever written, slot is write_index % capacity. Stored with
+  // release after the record, so readers acquire it before copying.
+  std::atomic<uint64_t> write_index;
+};
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "write_index is shared between processes");
+
+// Single producer ring buffer in a memory mapped file. The daemon appends one
+// record per tick with plain stores, history survives restarts and readers
+// map the same file to see it without any syscall into the daemon.
+class TelemetryRing {
+ public:
+  // Throws std::runtime_error if the file can't be created or mapped. An
+  // existing file with a matching layout is resumed, otherwise reset.
+  TelemetryRing(const std::string &path, uint32_t capacity);
+  TelemetryRing(const TelemetryRing &) = delete;
+  ~TelemetryRing();
+
+  void append(const telemetry_record &record);
+
+  const std::string &path() const { return _path; }
+  uint32_t           capacity() const { return _header->capacity; }
+
+ private:
+  const std::string _path;
+  size_t            _length;
+  telemetry_header *_header;
+  telemetry_record *_records;
+};
+
+// Read-only view of a ring written by another process
+class TelemetryReader {
+ public:
+  explicit TelemetryReader(const std::string &path);
+  TelemetryReader(const TelemetryReader &) = delete;
+  ~TelemetryReader();
+
+  uint64_t writeIndex() const {
+    return _header->write_index.load(std::memory_order_acquire);
+  }
+  uint32_t capacity() const { return _header->capacity; }
+  // Oldest index still held in the ring
+  uint64_t firstIndex() const;
+  // Copies record index into out, false if it was overwritten meanwhile or
+  // hasn't been written yet
+  bool read(uint64_t index, telemetry_record &out) const;
+
+ private:
+  size_t                  _length;
+  const telemetry_header *_header;
+  const telemetry_record *_records;
+};
+
+#endif  // TELEMETRY_RING_H
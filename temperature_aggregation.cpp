@@ -0,0 +1,94 @@
+#include "temperature_aggregation.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+TempAggregation stringToTempAggregation(const std::string &tas) {
+  if (tas == "package") {
+    return TempAggregation::PACKAGE;
+  } else if (tas == "max") {
+    return TempAggregation::MAX;
+  } else if (tas == "mean") {
+    return TempAggregation::MEAN;
+  } else if (tas == "top_k_mean") {
+    return TempAggregation::TOP_K_MEAN;
+  } else if (tas == "ewma_max") {
+    return TempAggregation::EWMA_MAX;
+  }
+  throw std::runtime_error("Unknown cpu_aggregation: " + tas);
+}
+
+int32_t reduce_min(const int32_t *temps, const size_t n) {
+  int32_t result = std::numeric_limits<int32_t>::max();
+  for (size_t i = 0; i < n; ++i) {
+    result = std::min(result, temps[i]);
+  }
+  return result;
+}
+
+int32_t reduce_max(const int32_t *temps, const size_t n) {
+  int32_t result = std::numeric_limits<int32_t>::min();
+  for (size_t i = 0; i < n; ++i) {
+    result = std::max(result, temps[i]);
+  }
+  return result;
+}
+
+int32_t reduce_mean(const int32_t *temps, const size_t n) {
+  int64_t sum = 0;
+  for (size_t i = 0; i < n; ++i) {
+    sum += temps[i];
+  }
+  return n == 0 ? 0 : static_cast<int32_t>(sum / static_cast<int64_t>(n));
+}
+
+int32_t reduce_top_k_mean(const int32_t *temps, const size_t n, size_t k) {
+  k = std::max<size_t>(1, std::min(k, n));
+  if (k == n) {
+    return reduce_mean(temps, n);
+  }
+  int32_t hottest[kMaxCoreSamples];
+  std::copy(temps, temps + n, hottest);
+  std::nth_element(hottest, hottest + k - 1, hottest + n,
+                   std::greater<int32_t>());
+  return reduce_mean(hottest, k);
+}
+
+int32_t TemperatureAggregator::aggregate(TempAggregation policy,
+                                         const int32_t * temps,
+                                         const size_t    n,
+                                         const size_t    k,
+                                         const float     alpha) {
+  if (n == 0 || reduce_min(temps, n) < 0) {
+    return std::numeric_limits<int>::min();
+  }
+  switch (policy) {
+  case TempAggregation::MEAN:
+    return reduce_mean(temps, n);
+  case TempAggregation::TOP_K_MEAN:
+    return reduce_top_k_mean(temps, n, k);
+  case TempAggregation::EWMA_MAX:
+    return ewmaMax(temps, n, alpha);
+  case TempAggregation::MAX:
+  case TempAggregation::PACKAGE:
+  default:
+    return reduce_max(temps, n);
+  }
+}
+
+int32_t TemperatureAggregator::ewmaMax(const int32_t *temps,
+                                       const size_t   n,
+                                       const float    alpha) {
+  // (Re)seed with the raw samples when the core count changes
+  if (_ewma_cores != n) {
+    std::copy(temps, temps + n, _ewma.begin());
+    _ewma_cores = n;
+  }
+  float result = 0.0f;
+  for (size_t i = 0; i < n; ++i) {
+    _ewma[i] += alpha * (static_cast<float>(temps[i]) - _ewma[i]);
+    result = std::max(result, _ewma[i]);
+  }
+  return static_cast<int32_t>(result + 0.5f);
+}
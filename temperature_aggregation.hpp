@@ -0,0 +1,43 @@
+#ifndef TEMPERATURE_AGGREGATION_H
+#define TEMPERATURE_AGGREGATION_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Upper bound on per-core samples taken in a single pass
+#define kMaxCoreSamples 256
+
+// How per-core samples are reduced to the single temperature fed to the
+// fan/pump curves. PACKAGE skips per-core sampling entirely.
+enum class TempAggregation { PACKAGE, MAX, MEAN, TOP_K_MEAN, EWMA_MAX };
+
+TempAggregation stringToTempAggregation(const std::string &tas);
+
+// Plain loops over contiguous arrays, written so the compiler can vectorize
+int32_t reduce_min(const int32_t *temps, const size_t n);
+int32_t reduce_max(const int32_t *temps, const size_t n);
+int32_t reduce_mean(const int32_t *temps, const size_t n);
+// Mean of the k hottest cores, k is clamped to [1, n]
+int32_t reduce_top_k_mean(const int32_t *temps, const size_t n, size_t k);
+
+// Keeps the per-core state EWMA_MAX needs between ticks
+class TemperatureAggregator {
+ public:
+  // A failed read of any core (negative sample) is returned as
+  // std::numeric_limits<int>::min() so the caller can fail safe
+  int32_t aggregate(TempAggregation policy,
+                    const int32_t * temps,
+                    const size_t    n,
+                    const size_t    k,
+                    const float     alpha);
+
+ private:
+  int32_t ewmaMax(const int32_t *temps, const size_t n, const float alpha);
+
+  std::array<float, kMaxCoreSamples> _ewma{};
+  size_t                             _ewma_cores{0};  // 0 until seeded
+};
+
+#endif  // TEMPERATURE_AGGREGATION_H
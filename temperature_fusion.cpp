@@ -0,0 +1,41 @@
+#include "temperature_fusion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+fused_temperature fuse_temperatures(const leviathan_config &config,
+                                    const int32_t *         temps) {
+  fused_temperature fused = {0, {kMinDuty, kMinDuty}};
+  if (config.fusion_mode_ == FusionMode::MAX_CURVE) {
+    bool first = true;
+    for (const auto &source : config.fusion_sources_) {
+      // A negative sample wraps past the end of the table, full duty
+      const uint32_t temp = static_cast<uint32_t>(temps[source.index_]);
+      const uint32_t fan  = source.fan_profile_.lookup(temp);
+      if (first || fan > fused.duty.fan) {
+        fused.temp     = temp;
+        fused.duty.fan = fan;
+      }
+      fused.duty.pump =
+        std::max(fused.duty.pump, source.pump_profile_.lookup(temp));
+      first = false;
+    }
+    return fused;
+  }
+
+  double sum    = 0;
+  double weight = 0;
+  for (const auto &source : config.fusion_sources_) {
+    const int32_t temp = temps[source.index_];
+    if (temp < 0) {
+      fused.temp = std::numeric_limits<int>::min();
+      return fused;
+    }
+    sum += source.weight_ * temp;
+    weight += source.weight_;
+  }
+  fused.temp =
+    weight > 0 ? static_cast<uint32_t>(std::lround(sum / weight)) : 0;
+  return fused;
+}
@@ -0,0 +1,22 @@
+#ifndef TEMPERATURE_FUSION_H
+#define TEMPERATURE_FUSION_H
+
+#include <cstdint>
+
+#include "fan_controller.hpp"
+#include "leviathan_config.hpp"
+
+struct fused_temperature {
+  uint32_t  temp;  // Control temperature
+  DutyCycle duty;  // Highest duty of the source curves, MAX_CURVE only
+};
+
+// Combines the source temperatures of one tick, indexed by slot (see
+// kCpuSource), according to the fusion settings of config. A failed read of
+// any source (negative sample) fails safe: WEIGHTED returns it as the
+// control temperature and MAX_CURVE saturates to full duty. With MAX_CURVE
+// temp is the temperature of the source that picked the fan duty.
+fused_temperature fuse_temperatures(const leviathan_config &config,
+                                    const int32_t *         temps);
+
+#endif  // TEMPERATURE_FUSION_H
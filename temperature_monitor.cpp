@@ -0,0 +1,26 @@
+#include "temperature_monitor.hpp"
+#include "cpu_temperature_monitor.hpp"
+#include "hwmon_temperature_monitor.hpp"
+
+#include <stdexcept>
+
+TempBackend stringToTempBackend(const std::string &tbs) {
+  if (tbs == "lmsensors") {
+    return TempBackend::LMSENSORS;
+  } else if (tbs == "hwmon") {
+    return TempBackend::HWMON;
+  }
+  throw std::runtime_error("temperature_backend must be \"lmsensors\" or "
+                           "\"hwmon\", got: " + tbs);
+}
+
+std::unique_ptr<TemperatureMonitor> make_temperature_monitor(
+  TempBackend backend) {
+  switch (backend) {
+  case TempBackend::HWMON:
+    return std::make_unique<HwmonTemperatureMonitor>();
+  case TempBackend::LMSENSORS:
+  default:
+    return std::make_unique<CpuTemperatureMonitor>();
+  }
+}
@@ -0,0 +1,34 @@
+#ifndef TEMPERATURE_MONITOR_H
+#define TEMPERATURE_MONITOR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+// Backends selectable through the temperature_backend config key
+enum class TempBackend { LMSENSORS, HWMON };
+
+TempBackend stringToTempBackend(const std::string &tbs);
+
+// Common interface of the CPU temperature readers. On a failed read the
+// methods return std::numeric_limits<int>::min() cast to uint32_t.
+class TemperatureMonitor {
+ public:
+  virtual ~TemperatureMonitor() = default;
+
+  // Returns the temperature of the CPU heat sink itself
+  virtual uint32_t getPackageIdTemperature() const = 0;
+  // Returns the temperature of an individual core
+  virtual uint32_t getCoreIdTemperature(uint8_t core_id) const = 0;
+  // Returns the number of physical cores in the CPU
+  virtual size_t coreCount() const = 0;
+  // Samples every core in one pass into out, returns the number written
+  virtual size_t sampleCoreTemperatures(int32_t *out,
+                                        size_t   capacity) const = 0;
+};
+
+std::unique_ptr<TemperatureMonitor> make_temperature_monitor(
+  TempBackend backend);
+
+#endif  // TEMPERATURE_MONITOR_H
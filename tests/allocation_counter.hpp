@@ -0,0 +1,11 @@
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <cstdint>
+
+// Number of global operator new calls so far in the whole process. Linking
+// allocation_counter.cpp replaces operator new to count them, diff two
+// readings to count the allocations of the code in between.
+uint64_t allocation_count();
+
+#endif  // ALLOCATION_COUNTER_H
@@ -0,0 +1,48 @@
+// Runs control ticks against simulated Krakens and fails if a warmed up tick
+// makes any heap allocation
+#include <cstdio>
+#include <glog/logging.h>
+
+#include "allocation_counter.hpp"
+#include "leviathan_service.hpp"
+
+// Sync usb transfers and no conky file, then the default thread transport
+// with the conky file rewritten as the load swings
+const char *const kTestConfigFiles[] = {
+  LEVD_SOURCE_DIR "/bench/levd_bench.cfg",
+  LEVD_SOURCE_DIR "/tests/control_tick_thread.cfg"};
+// Ticks before allocations are counted, lets lazily sized state settle
+#define kWarmupTicks 16
+#define kCountedTicks 1000
+
+bool allocation_free(const char *const config_file) {
+  SimulatedService service(config_file);
+  for (int i = 0; i < kWarmupTicks; ++i) {
+    service.tick();
+  }
+  const uint64_t allocations = allocation_count();
+  for (int i = 0; i < kCountedTicks; ++i) {
+    service.tick();
+  }
+  const uint64_t allocated = allocation_count() - allocations;
+  if (allocated > 0) {
+    fprintf(stderr, "FAIL: %lu allocations in %d steady state ticks of %s\n",
+            (unsigned long)allocated, kCountedTicks, config_file);
+    return false;
+  }
+  printf("No allocations in %d steady state ticks of %s\n", kCountedTicks,
+         config_file);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  FLAGS_logtostderr = 1;
+  FLAGS_minloglevel = google::WARNING;
+  google::InitGoogleLogging(argv[0]);
+
+  bool passed = true;
+  for (const char *const config_file : kTestConfigFiles) {
+    passed &= allocation_free(config_file);
+  }
+  return passed ? 0 : 1;
+}
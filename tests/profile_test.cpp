@@ -0,0 +1,109 @@
+// Compiles fan/pump profiles and checks every entry of the lookup table
+// against the exact piecewise linear curve, computed independently in
+// rational arithmetic.
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+
+#include "leviathan_config.hpp"
+
+#define kRandomProfiles 2000
+
+static int failures = 0;
+
+// Exact value of the segment a-b at x, floored, then down to a multiple of 5
+static int32_t exact_profile_value(const Point &a, const Point &b, int32_t x) {
+  const int64_t num = static_cast<int64_t>(x - a.x) * (b.y - a.y);
+  const int64_t den = b.x - a.x;
+  int64_t       q   = num / den;
+  if ((num % den != 0) && ((num < 0) != (den < 0))) {
+    --q;  // floor, not truncation
+  }
+  const int32_t y = a.y + static_cast<int32_t>(q);
+  return y - y % 5;
+}
+
+// What configure_profile must produce for the user's points: implicit
+// (0, kMinDuty) and (100, kMaxDuty) ends, flat past the last point, clamped
+// to the duty range
+static int32_t expected_duty(std::vector<Point> points, int32_t t) {
+  points.emplace_back(0, kMinDuty);
+  points.emplace_back(100, kMaxDuty);
+  std::stable_sort(points.begin(), points.end(),
+                   [](const Point &p, const Point &u) { return p.x < u.x; });
+  size_t segment = 0;
+  while (segment + 2 < points.size() && t >= points[segment + 1].x) {
+    ++segment;
+  }
+  const Point & a     = points[segment];
+  const Point & b     = points[segment + 1];
+  const int32_t value = exact_profile_value(a, b, std::min(t, b.x));
+  return std::max<int32_t>(kMinDuty, std::min<int32_t>(kMaxDuty, value));
+}
+
+static void check_profile(const std::vector<Point> &points) {
+  YAML::Node profile(YAML::NodeType::Sequence);
+  std::string description;
+  for (const Point &p : points) {
+    YAML::Node pair(YAML::NodeType::Sequence);
+    pair.push_back(p.x);
+    pair.push_back(p.y);
+    profile.push_back(pair);
+    description += " [" + std::to_string(p.x) + ", " + std::to_string(p.y) + "]";
+  }
+  const CompiledProfile compiled = configure_profile(profile);
+  for (int32_t t = 0; t < kProfileTableSize; ++t) {
+    const int32_t expected = expected_duty(points, t);
+    if (compiled.lookup(t) != static_cast<uint32_t>(expected)) {
+      fprintf(stderr, "FAIL:%s at %dC: table %u, curve %d\n",
+              description.c_str(), t, compiled.lookup(t), expected);
+      ++failures;
+      return;
+    }
+  }
+  // Anything hotter than the table reads the last entry
+  if (compiled.lookup(1000) != compiled.lookup(kProfileTableSize - 1)) {
+    fprintf(stderr, "FAIL:%s past the end of the table\n",
+            description.c_str());
+    ++failures;
+  }
+}
+
+int main() {
+  // The sample config's curves, and a few shapes with steep, flat and
+  // falling segments
+  check_profile({{30, 30}, {35, 40}, {40, 60}, {42, 70}, {43, 80}, {45, 100}});
+  check_profile({{30, 50}, {40, 70}, {50, 100}});
+  check_profile({});
+  check_profile({{1, 100}});
+  check_profile({{99, 30}});
+  check_profile({{50, 30}, {51, 100}});
+  check_profile({{20, 80}, {60, 40}, {70, 90}});
+  check_profile({{37, 35}, {41, 45}, {73, 55}, {97, 95}});
+
+  // Random profiles with distinct temperatures in (0, 100)
+  std::mt19937 rng(42);
+  for (int i = 0; i < kRandomProfiles; ++i) {
+    std::vector<int32_t> temps(99);
+    for (int32_t t = 1; t < 100; ++t) {
+      temps[t - 1] = t;
+    }
+    std::shuffle(temps.begin(), temps.end(), rng);
+    temps.resize(std::uniform_int_distribution<int>(1, 8)(rng));
+    std::vector<Point> points;
+    for (const int32_t t : temps) {
+      points.emplace_back(t, 5 * std::uniform_int_distribution<int>(0, 20)(rng));
+    }
+    check_profile(points);
+  }
+
+  if (failures > 0) {
+    fprintf(stderr, "%d profiles diverge from their curve\n", failures);
+    return 1;
+  }
+  printf("All profiles match their curve\n");
+  return 0;
+}
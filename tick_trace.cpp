@@ -0,0 +1,220 @@
+#include "tick_trace.hpp"
+
+#include <algorithm>
+#include <glog/logging.h>
+#include <memory>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+#define kTraceCapacity (1 << 16)  // Events per capture, ~1.5MB
+
+struct trace_event {
+  uint64_t   start_ns;
+  uint64_t   end_ns;
+  uint32_t   tid;
+  TraceStage stage;
+};
+
+static LatencyHistogram
+  stage_histograms[static_cast<size_t>(TraceStage::COUNT)];
+
+// Capture state. The buffer is allocated by the first capture and kept, the
+// hot path only claims slots through next_event. Spans are recorded from the
+// control loop and the usb I/O threads alike, writers counts the ones
+// between checking capturing and publishing their slot so that finishing
+// can wait for them before reading the buffer.
+static std::unique_ptr<trace_event[]> events;
+static std::atomic<bool>              capturing{false};
+static std::atomic<size_t>            next_event{0};
+static std::atomic<uint32_t>          writers{0};
+static uint64_t                       capture_end_ns = 0;
+
+static uint32_t thread_id() {
+  static thread_local const uint32_t tid = syscall(SYS_gettid);
+  return tid;
+}
+
+const char *traceStageToString(TraceStage stage) {
+  switch (stage) {
+  case TraceStage::TICK:
+    return "tick";
+  case TraceStage::CONFIG_RELOAD:
+    return "config_reload";
+  case TraceStage::USB_EVENTS:
+    return "usb_events";
+  case TraceStage::RECONNECT:
+    return "reconnect";
+  case TraceStage::COLOR_UPDATE:
+    return "color_update";
+  case TraceStage::SENSORS:
+    return "sensors";
+  case TraceStage::CONTROLLER:
+    return "controller";
+  case TraceStage::SPEED_UPDATE:
+    return "speed_update";
+  case TraceStage::PUBLISH:
+    return "publish";
+  case TraceStage::CONKY_FILE:
+    return "conky_file";
+  case TraceStage::USB_BATCH:
+    return "usb_batch";
+  case TraceStage::USB_CONTROL:
+    return "usb_control";
+  case TraceStage::USB_BULK_OUT:
+    return "usb_bulk_out";
+  case TraceStage::USB_BULK_IN:
+    return "usb_bulk_in";
+  default:
+    return "unknown";
+  }
+}
+
+/** ********** LatencyHistogram ********** */
+
+size_t LatencyHistogram::bucketIndex(uint64_t ns) {
+  if (ns < kHistogramSubBuckets) {
+    return ns;
+  }
+  const int msb = 63 - __builtin_clzll(ns);
+  const int sub =
+    (ns >> (msb - kHistogramSubBits)) & (kHistogramSubBuckets - 1);
+  return (msb - kHistogramSubBits + 1) * kHistogramSubBuckets + sub;
+}
+
+uint64_t LatencyHistogram::bucketUpperBound(size_t index) {
+  if (index < kHistogramSubBuckets) {
+    return index;
+  }
+  const int      shift = index / kHistogramSubBuckets - 1;
+  const uint64_t lower = (kHistogramSubBuckets + index % kHistogramSubBuckets)
+                         << shift;
+  return lower + ((uint64_t)1 << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+  _buckets[bucketIndex(ns)].fetch_add(1, std::memory_order_relaxed);
+  _count.fetch_add(1, std::memory_order_relaxed);
+  uint64_t max = _max.load(std::memory_order_relaxed);
+  while (ns > max
+         && !_max.compare_exchange_weak(max, ns, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t LatencyHistogram::percentile(double q) const {
+  const uint64_t total = count();
+  if (total == 0) {
+    return 0;
+  }
+  // Rank of the quantile, 1 based
+  const uint64_t rank = std::max<uint64_t>(1, q * total + 0.5);
+  uint64_t       seen = 0;
+  for (size_t i = 0; i < kHistogramBuckets; ++i) {
+    seen += _buckets[i].load(std::memory_order_relaxed);
+    if (seen >= rank) {
+      return std::min(bucketUpperBound(i), max());
+    }
+  }
+  return max();
+}
+
+/** ********** Spans ********** */
+
+void trace_span(TraceStage stage, uint64_t start_ns, uint64_t end_ns) {
+  stage_histograms[static_cast<size_t>(stage)].record(end_ns - start_ns);
+  if (!capturing.load(std::memory_order_relaxed)) {
+    return;
+  }
+  // Announce the write before checking again, finish_trace_capture clears
+  // capturing before it waits for writers to drain. Both sides are seq_cst
+  // so neither can miss the other.
+  writers.fetch_add(1, std::memory_order_seq_cst);
+  if (capturing.load(std::memory_order_seq_cst)) {
+    const size_t i = next_event.fetch_add(1, std::memory_order_relaxed);
+    if (i < kTraceCapacity) {
+      events[i] = {start_ns, end_ns, thread_id(), stage};
+    }
+  }
+  writers.fetch_sub(1, std::memory_order_release);
+}
+
+const LatencyHistogram &stage_histogram(TraceStage stage) {
+  return stage_histograms[static_cast<size_t>(stage)];
+}
+
+void log_stage_histograms() {
+  LOG(INFO) << "Tick stage latencies in microseconds (count p50 p99 max):";
+  for (size_t i = 0; i < static_cast<size_t>(TraceStage::COUNT); ++i) {
+    const LatencyHistogram &histogram = stage_histograms[i];
+    if (histogram.count() == 0) {
+      continue;
+    }
+    char line[128];
+    snprintf(line, sizeof(line), "%-14s %10lu %10.1f %10.1f %10.1f",
+             traceStageToString(static_cast<TraceStage>(i)),
+             (unsigned long)histogram.count(),
+             histogram.percentile(0.5) / 1000.0,
+             histogram.percentile(0.99) / 1000.0, histogram.max() / 1000.0);
+    LOG(INFO) << line;
+  }
+}
+
+/** ********** Chrome trace capture ********** */
+
+bool start_trace_capture(std::chrono::seconds window) {
+  if (capturing.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  if (!events) {
+    events = std::make_unique<trace_event[]>(kTraceCapacity);
+  }
+  // No writer is left from the previous capture, finishing drained them
+  next_event.store(0, std::memory_order_relaxed);
+  capture_end_ns =
+    monotonic_ns()
+    + std::chrono::duration_cast<std::chrono::nanoseconds>(window).count();
+  capturing.store(true, std::memory_order_release);
+  return true;
+}
+
+bool finish_trace_capture(const std::string &path) {
+  if (!capturing.load(std::memory_order_relaxed)
+      || (monotonic_ns() < capture_end_ns
+          && next_event.load(std::memory_order_relaxed) < kTraceCapacity)) {
+    return false;
+  }
+  capturing.store(false, std::memory_order_seq_cst);
+  // Every slot claimed so far is complete once the writers have drained
+  while (writers.load(std::memory_order_seq_cst) != 0) {
+    std::this_thread::yield();
+  }
+  const size_t num_events =
+    std::min<size_t>(next_event.load(std::memory_order_relaxed),
+                     kTraceCapacity);
+
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == NULL) {
+    PLOG(ERROR) << "Failed to open trace file " << path;
+    return true;
+  }
+  // Complete events, timestamps in microseconds
+  const int pid = getpid();
+  fprintf(file, "{\"traceEvents\":[");
+  for (size_t i = 0; i < num_events; ++i) {
+    const trace_event &event = events[i];
+    fprintf(file,
+            "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":%d,\"tid\":%u}",
+            i == 0 ? "" : ",", traceStageToString(event.stage),
+            event.start_ns / 1000.0,
+            (event.end_ns - event.start_ns) / 1000.0, pid, event.tid);
+  }
+  fprintf(file, "\n],\"displayTimeUnit\":\"ns\"}\n");
+  if (fclose(file) != 0) {
+    PLOG(ERROR) << "Failed to write trace file " << path;
+    return true;
+  }
+  LOG(INFO) << "Wrote " << num_events << " trace events to " << path;
+  return true;
+}
@@ -0,0 +1,91 @@
+#ifndef TICK_TRACE_H
+#define TICK_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Stages of a control tick that get their own latency histogram
+enum class TraceStage {
+  TICK,           // The whole tick
+  CONFIG_RELOAD,  // Swapping in a new config snapshot
+  USB_EVENTS,     // libusb_handle_events, completes async transfers
+  RECONNECT,      // Rescanning the bus for missing devices
+  COLOR_UPDATE,   // Color sequence and status read of one device
+  SENSORS,        // CPU temperature, any backend
+  CONTROLLER,     // Curve or PID update of one device
+  SPEED_UPDATE,   // Fan/pump sequence and status read of one device
+  PUBLISH,        // Telemetry, status page and metrics of one device
+  CONKY_FILE,
+  USB_BATCH,      // Async batch of one device, submission to completion
+  USB_CONTROL,    // One control transfer
+  USB_BULK_OUT,   // One bulk write, up to 64 bytes per packet
+  USB_BULK_IN,    // One bulk read
+  COUNT
+};
+
+const char *traceStageToString(TraceStage stage);
+
+inline uint64_t monotonic_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch())
+    .count();
+}
+
+#define kHistogramSubBits 3  // 8 linear buckets per power of 2, <= 12.5% error
+#define kHistogramSubBuckets (1 << kHistogramSubBits)
+#define kHistogramBuckets ((64 - kHistogramSubBits + 1) * kHistogramSubBuckets)
+
+// Log-linear histogram of nanosecond durations, fixed size and lock free.
+// Recording is a few relaxed atomic increments, safe from any thread.
+class LatencyHistogram {
+ public:
+  void record(uint64_t ns);
+
+  uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+  uint64_t max() const { return _max.load(std::memory_order_relaxed); }
+  // Upper bound of the bucket holding the q quantile, q within [0, 1]
+  uint64_t percentile(double q) const;
+
+  static size_t   bucketIndex(uint64_t ns);
+  static uint64_t bucketUpperBound(size_t index);
+
+ private:
+  std::atomic<uint64_t> _buckets[kHistogramBuckets] = {};
+  std::atomic<uint64_t> _count{0};
+  std::atomic<uint64_t> _max{0};
+};
+
+// Records one span of a stage into its histogram, and into the Chrome trace
+// capture while one is running
+void trace_span(TraceStage stage, uint64_t start_ns, uint64_t end_ns);
+
+// Times its own scope
+class TraceSpan {
+ public:
+  explicit TraceSpan(TraceStage stage)
+    : _stage(stage), _start(monotonic_ns()) {}
+  TraceSpan(const TraceSpan &) = delete;
+  ~TraceSpan() { trace_span(_stage, _start, monotonic_ns()); }
+
+ private:
+  const TraceStage _stage;
+  const uint64_t   _start;
+};
+
+const LatencyHistogram &stage_histogram(TraceStage stage);
+// Logs count, p50, p99 and max of every stage that recorded anything
+void log_stage_histograms();
+
+// Chrome trace-event capture. Spans are recorded into a preallocated buffer
+// for window, then finish_trace_capture() writes them to path as JSON that
+// chrome://tracing and Perfetto can load. Returns false if a capture is
+// already running.
+bool start_trace_capture(std::chrono::seconds window);
+// Called between ticks, writes the capture out once its window has passed or
+// the buffer is full. Returns true if it did.
+bool finish_trace_capture(const std::string &path);
+
+#endif  // TICK_TRACE_H
@@ -0,0 +1,228 @@
+// Replays a session captured through session_file as fast as the CPU allows,
+// to check a new fan/pump profile against recorded load.
+//
+//   levd_replay [-c config] [-v] <capture>
+//
+// Every recorded tick is fed through the controller of the config, with the
+// recorded sensor samples and the time between ticks. Prints per device how
+// the replayed duty cycles compare to the recorded ones, -v also prints every
+// tick where they differ. Hwmon sensors must be declared in the same order as
+// when the session was captured.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <glog/logging.h>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "constants.h"
+#include "fan_controller.hpp"
+#include "kraken_driver.hpp"
+#include "leviathan_config.hpp"
+#include "session_trace.hpp"
+#include "temperature_fusion.hpp"
+
+struct duty_stats {
+  uint64_t fan_sum;
+  uint64_t pump_sum;
+  uint64_t full_duty;  // Ticks with the fan at kMaxDuty
+};
+
+// Everything replayed for one device index
+struct replay_device {
+  std::string                    serial;
+  const leviathan_config *       config = nullptr;
+  std::unique_ptr<FanController> controller;
+  uint64_t                       first_ns = 0;
+  uint64_t                       last_ns  = 0;
+  uint64_t                       ticks    = 0;
+  uint64_t                       forced   = 0;  // Override or failsafe
+  uint64_t                       differing = 0;
+  uint32_t                       max_difference = 0;
+  uint32_t                       max_control_temp = 0;
+  duty_stats                     recorded = {};
+  duty_stats                     replayed = {};
+  uint64_t                       frames_out = 0;
+  uint64_t                       frames_in  = 0;
+  uint32_t                       min_liquid = UINT32_MAX;
+  uint32_t                       max_liquid = 0;
+};
+
+bool g_verbose = false;
+
+void add_duty(duty_stats &stats, uint32_t fan, uint32_t pump) {
+  stats.fan_sum += fan;
+  stats.pump_sum += pump;
+  stats.full_duty += fan == kMaxDuty;
+}
+
+void replay_tick(replay_device &       device,
+                 uint8_t               index,
+                 uint64_t              timestamp_ns,
+                 const session_tick &  tick) {
+  const leviathan_config &config = *device.config;
+  const double            dt =
+    device.ticks == 0 ? 0.0 : (timestamp_ns - device.last_ns) / 1e9;
+  if (device.ticks == 0) {
+    device.first_ns = timestamp_ns;
+  }
+  device.last_ns = timestamp_ns;
+  ++device.ticks;
+
+  uint32_t  control_temp = config.temp_source_ == TempSource::LIQUID
+                             ? tick.sources[kLiquidSource]
+                             : tick.sources[kCpuSource];
+  DutyCycle duty;
+  if (config.temp_source_ == TempSource::FUSED) {
+    const fused_temperature fused = fuse_temperatures(config, tick.sources);
+    control_temp                  = fused.temp;
+    duty = config.fusion_mode_ == FusionMode::MAX_CURVE
+             ? device.controller->follow(fused.duty, dt)
+             : device.controller->update(control_temp, dt, config);
+  } else {
+    duty = device.controller->update(control_temp, dt, config);
+  }
+  if (control_temp <= kMaxPlausibleTemp) {
+    device.max_control_temp = std::max(device.max_control_temp, control_temp);
+  }
+  add_duty(device.recorded, tick.fan_duty, tick.pump_duty);
+  add_duty(device.replayed, duty.fan, duty.pump);
+  if (tick.flags & kSessionForced) {
+    ++device.forced;
+    return;
+  }
+  const uint32_t difference =
+    std::max(std::abs((int32_t)duty.fan - tick.fan_duty),
+             std::abs((int32_t)duty.pump - tick.pump_duty));
+  if (difference == 0) {
+    return;
+  }
+  ++device.differing;
+  device.max_difference = std::max(device.max_difference, difference);
+  if (g_verbose) {
+    printf("%u\t%.3f\t%u\t%u/%u\t%u/%u\n", index,
+           (timestamp_ns - device.first_ns) / 1e9, control_temp,
+           tick.fan_duty, tick.pump_duty, duty.fan, duty.pump);
+  }
+}
+
+void print_summary(uint8_t index, const replay_device &device) {
+  if (device.ticks == 0) {
+    return;
+  }
+  const double ticks = device.ticks;
+  printf("device %u (%s): %lu ticks over %.1fs\n", index,
+         device.serial.empty() ? "unknown" : device.serial.c_str(),
+         (unsigned long)device.ticks,
+         (device.last_ns - device.first_ns) / 1e9);
+  printf("  %-18s %10s %10s\n", "", "recorded", "replayed");
+  printf("  %-18s %10.1f %10.1f\n", "mean fan duty",
+         device.recorded.fan_sum / ticks, device.replayed.fan_sum / ticks);
+  printf("  %-18s %10.1f %10.1f\n", "mean pump duty",
+         device.recorded.pump_sum / ticks, device.replayed.pump_sum / ticks);
+  printf("  %-18s %9.1f%% %9.1f%%\n", "fan at full duty",
+         100.0 * device.recorded.full_duty / ticks,
+         100.0 * device.replayed.full_duty / ticks);
+  printf("  differing ticks %lu (%.1f%%), by up to %u%%, %lu forced ticks "
+         "not compared\n",
+         (unsigned long)device.differing, 100.0 * device.differing / ticks,
+         device.max_difference, (unsigned long)device.forced);
+  printf("  peak control temperature %uC", device.max_control_temp);
+  if (device.frames_in > 0) {
+    printf(", liquid %u-%uC", device.min_liquid, device.max_liquid);
+  }
+  printf(", %lu usb frames out, %lu status frames\n",
+         (unsigned long)device.frames_out, (unsigned long)device.frames_in);
+}
+
+int usage(const char *argv0) {
+  fprintf(stderr, "usage: %s [-c config] [-v] <capture>\n", argv0);
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  FLAGS_logtostderr = 1;
+  google::InitGoogleLogging(argv[0]);
+  std::string config_path = kDefaultConfigFile;
+  int         arg         = 1;
+  if (arg + 1 < argc && strcmp(argv[arg], "-c") == 0) {
+    config_path = argv[arg + 1];
+    arg += 2;
+  }
+  if (arg < argc && strcmp(argv[arg], "-v") == 0) {
+    g_verbose = true;
+    ++arg;
+  }
+  if (arg + 1 != argc) {
+    return usage(argv[0]);
+  }
+  const auto config = try_parse_config_file(config_path.c_str());
+  if (!config) {
+    return 1;
+  }
+
+  try {
+    SessionReader                   reader(argv[arg]);
+    std::map<uint8_t, replay_device> devices;
+    session_record_header            record;
+    unsigned char                    payload[kMaxSessionPayload];
+    uint64_t                         records = 0;
+    if (g_verbose) {
+      printf("device\tseconds\tcontrol_temp\trecorded\treplayed\n");
+    }
+    const auto start = std::chrono::steady_clock::now();
+    while (reader.next(record, payload)) {
+      ++records;
+      replay_device &device = devices[record.device];
+      if (!device.controller) {
+        device.config     = &*config;
+        device.controller = make_fan_controller(config->controller_);
+      }
+      switch (record.type) {
+      case SessionRecord::DEVICE:
+        device.serial.assign(reinterpret_cast<char *>(payload),
+                             record.length);
+        if (device.config != &device_config(*config, device.serial)) {
+          device.config = &device_config(*config, device.serial);
+          device.controller = make_fan_controller(device.config->controller_);
+        }
+        break;
+      case SessionRecord::TICK:
+        if (record.length == sizeof(session_tick)) {
+          session_tick tick;
+          memcpy(&tick, payload, sizeof(tick));
+          replay_tick(device, record.device, record.timestamp_ns, tick);
+        }
+        break;
+      case SessionRecord::USB_CONTROL:
+      case SessionRecord::USB_OUT:
+        ++device.frames_out;
+        break;
+      case SessionRecord::USB_IN:
+        if (record.length == 32) {
+          const KrakenStatus status = KrakenDriver::parseStatus(payload);
+          device.min_liquid = std::min(device.min_liquid, status.liquid_temp);
+          device.max_liquid = std::max(device.max_liquid, status.liquid_temp);
+          ++device.frames_in;
+        }
+        break;
+      }
+    }
+    const double elapsed = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+    for (const auto &device : devices) {
+      print_summary(device.first, device.second);
+    }
+    printf("replayed %lu records in %.3fs\n", (unsigned long)records,
+           elapsed);
+  } catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+// Prints the daemon's current status from its shared memory status page.
+//
+//   levd_status [--device n] [--simulated] [--conky] [--watch [ms]]
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <thread>
+
+#include "status_client.hpp"
+
+void print_status(const levd_status &s, bool conky) {
+  if (conky) {
+    // Same lines the daemon used to write into conky_file
+    printf("Kraken Serial: %s\nFan Speed: %u\nPump Speed: %u\nWater Temp: %d\n",
+           s.serial, s.fan_rpm, s.pump_rpm, s.liquid_temp);
+    return;
+  }
+  printf("serial=%s cpu_temp=%d liquid_temp=%d fan_duty=%u pump_duty=%u "
+         "fan_rpm=%u pump_rpm=%u color=0x%06x connected=%u ticks=%llu\n",
+         s.serial, s.cpu_temp, s.liquid_temp, s.fan_duty, s.pump_duty,
+         s.fan_rpm, s.pump_rpm, s.color, s.connected,
+         static_cast<unsigned long long>(s.ticks));
+}
+
+int main(int argc, char *argv[]) {
+  bool conky     = false;
+  int  watch_ms  = 0;
+  int  device    = 0;
+  bool simulated = false;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "--conky") == 0) {
+      conky = true;
+    } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+      device = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--simulated") == 0) {
+      simulated = true;
+    } else if (strcmp(argv[i], "--watch") == 0) {
+      watch_ms = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i])
+                                                         : 500;
+    } else {
+      fprintf(stderr, "usage: %s [--device n] [--simulated] [--conky] [--watch [ms]]\n", argv[0]);
+      return 1;
+    }
+  }
+  try {
+    StatusClient client(status_page_name(device, simulated).c_str());
+    levd_status  status;
+    uint32_t     seen = ~0u;  // Always print the current status once
+    do {
+      if (client.version() != seen) {
+        seen = client.version();
+        if (!client.read(status)) {
+          fprintf(stderr, "Unable to read a consistent status\n");
+          return 1;
+        }
+        print_status(status, conky);
+        fflush(stdout);
+      }
+      if (watch_ms > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(watch_ms));
+      }
+    } while (watch_ms > 0);
+  } catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,167 @@
+// Reads the telemetry history levd keeps in a memory mapped ring buffer.
+//
+//   levd_telemetry [-f file] [-d device] dump
+//   levd_telemetry [-f file] [-d device] tail [count] [--follow]
+//   levd_telemetry [-f file] [-d device] downsample <seconds>
+//
+// Records of every Kraken are shown unless -d selects one of them.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <string>
+#include <thread>
+
+#include "constants.h"
+#include "telemetry_ring.hpp"
+
+// Device index to show, or -1 for all of them
+int g_device = -1;
+
+bool selected(const telemetry_record &r) {
+  return g_device < 0 || r.device == g_device;
+}
+
+void print_header() {
+  printf("time\tdevice\tcpu_temp\tliquid_temp\tfan_duty\tpump_duty\tfan_rpm\tpump_"
+         "rpm\n");
+}
+
+void print_time(uint64_t timestamp_ns) {
+  const time_t seconds = timestamp_ns / 1000000000;
+  struct tm    tm;
+  char         buffer[32];
+  localtime_r(&seconds, &tm);
+  strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &tm);
+  printf("%s.%03u", buffer,
+         static_cast<unsigned>(timestamp_ns / 1000000 % 1000));
+}
+
+void print_record(const telemetry_record &r) {
+  print_time(r.timestamp_ns);
+  printf("\t%u\t%d\t%d\t%u\t%u\t%u\t%u\n", r.device, r.cpu_temp,
+         r.liquid_temp, r.fan_duty, r.pump_duty, r.fan_rpm, r.pump_rpm);
+}
+
+// Prints records [begin, end), returns the index to continue from
+uint64_t print_range(const TelemetryReader &reader,
+                     uint64_t               begin,
+                     uint64_t               end) {
+  telemetry_record record;
+  for (uint64_t i = std::max(begin, reader.firstIndex()); i < end; ++i) {
+    if (reader.read(i, record) && selected(record)) {
+      print_record(record);
+    }
+  }
+  return end;
+}
+
+// Averages every field over consecutive windows of the given length
+void downsample(const TelemetryReader &reader, uint64_t window_s) {
+  const uint64_t   window_ns = window_s * 1000000000ull;
+  telemetry_record record;
+  uint64_t         bucket = 0, count = 0;
+  double           sums[6] = {0};
+  const auto       flush   = [&]() {
+    if (count == 0) {
+      return;
+    }
+    print_time(bucket * window_ns);
+    if (g_device < 0) {
+      printf("\t*");
+    } else {
+      printf("\t%d", g_device);
+    }
+    printf("\t%.1f\t%.1f\t%.1f\t%.1f\t%.0f\t%.0f\n", sums[0] / count,
+           sums[1] / count, sums[2] / count, sums[3] / count, sums[4] / count,
+           sums[5] / count);
+    memset(sums, 0, sizeof(sums));
+    count = 0;
+  };
+  const uint64_t end = reader.writeIndex();
+  for (uint64_t i = reader.firstIndex(); i < end; ++i) {
+    if (!reader.read(i, record) || !selected(record)) {
+      continue;
+    }
+    const uint64_t b = record.timestamp_ns / window_ns;
+    if (b != bucket) {
+      flush();
+      bucket = b;
+    }
+    sums[0] += record.cpu_temp;
+    sums[1] += record.liquid_temp;
+    sums[2] += record.fan_duty;
+    sums[3] += record.pump_duty;
+    sums[4] += record.fan_rpm;
+    sums[5] += record.pump_rpm;
+    ++count;
+  }
+  flush();
+}
+
+int usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-f file] [-d device] dump\n"
+          "       %s [-f file] [-d device] tail [count] [--follow]\n"
+          "       %s [-f file] [-d device] downsample <seconds>\n",
+          argv0, argv0, argv0);
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  std::string path = kDefaultTelemetryFile;
+  int         arg  = 1;
+  if (arg + 1 < argc && strcmp(argv[arg], "-f") == 0) {
+    path = argv[arg + 1];
+    arg += 2;
+  }
+  if (arg + 1 < argc && strcmp(argv[arg], "-d") == 0) {
+    g_device = atoi(argv[arg + 1]);
+    arg += 2;
+  }
+  if (arg >= argc) {
+    return usage(argv[0]);
+  }
+  const std::string command = argv[arg++];
+  try {
+    TelemetryReader reader(path);
+    if (command == "dump") {
+      print_header();
+      print_range(reader, 0, reader.writeIndex());
+    } else if (command == "tail") {
+      uint64_t count  = 20;
+      bool     follow = false;
+      for (; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "--follow") == 0) {
+          follow = true;
+        } else {
+          count = strtoull(argv[arg], NULL, 10);
+        }
+      }
+      print_header();
+      const uint64_t end  = reader.writeIndex();
+      uint64_t       next = print_range(reader, end > count ? end - count : 0, end);
+      while (follow) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(250));
+        next = print_range(reader, next, reader.writeIndex());
+        fflush(stdout);
+      }
+    } else if (command == "downsample" && arg < argc) {
+      const uint64_t window_s = strtoull(argv[arg], NULL, 10);
+      if (window_s == 0) {
+        return usage(argv[0]);
+      }
+      print_header();
+      downsample(reader, window_s);
+    } else {
+      return usage(argv[0]);
+    }
+  } catch (std::exception &e) {
+    fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,34 @@
+#include "unix_socket.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define kListenBacklog 8
+
+int listen_unix_socket(const std::string &path, mode_t mode) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family         = AF_UNIX;
+  if (path.size() >= sizeof(addr.sun_path)) {
+    throw std::runtime_error("Socket path too long: " + path);
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    throw std::runtime_error(std::string("socket(): ") + strerror(errno));
+  }
+  unlink(path.c_str());  // Left behind by a previous instance
+  if (bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0
+      || chmod(path.c_str(), mode) != 0 || listen(fd, kListenBacklog) != 0) {
+    const std::string error = strerror(errno);
+    close(fd);
+    throw std::runtime_error("Unable to listen on " + path + ": " + error);
+  }
+  return fd;
+}
@@ -0,0 +1,12 @@
+#ifndef UNIX_SOCKET_H
+#define UNIX_SOCKET_H
+
+#include <string>
+
+#include <sys/types.h>
+
+// Non-blocking listening stream socket bound at path with the given
+// permissions, replacing a stale socket file. Throws std::runtime_error.
+int listen_unix_socket(const std::string &path, mode_t mode);
+
+#endif  // UNIX_SOCKET_H
@@ -0,0 +1,133 @@
+#include "usb_async_transfer.hpp"
+
+#include <glog/logging.h>
+#include <string.h>
+
+AsyncTransferBatch::AsyncTransferBatch(libusb_device_handle *handle,
+                                       unsigned char         endpoint_out,
+                                       unsigned char         endpoint_in)
+  : _handle(handle), _endpointOut(endpoint_out), _endpointIn(endpoint_in) {
+  for (auto &transfer : _transfers) {
+    transfer = libusb_alloc_transfer(0);
+    CHECK(transfer != NULL) << "Failed to allocate libusb transfer";
+  }
+  memset(_last_read, 0, sizeof(_last_read));
+}
+
+AsyncTransferBatch::~AsyncTransferBatch() {
+  cancel();
+  for (auto &transfer : _transfers) {
+    libusb_free_transfer(transfer);
+  }
+}
+
+/** ********** Public interface ********** */
+
+void AsyncTransferBatch::clear() {
+  CHECK(_state != State::IN_FLIGHT) << "Cannot modify a batch in flight";
+  _num_steps = 0;
+}
+
+void AsyncTransferBatch::addControl(uint16_t value) {
+  CHECK(_num_steps < kMaxBatchTransfers) << "Too many transfers in batch";
+  unsigned char *buffer = _buffers[_num_steps];
+  libusb_fill_control_setup(buffer, 0x40, 2, value, 0, 0);
+  libusb_fill_control_transfer(_transfers[_num_steps], _handle, buffer,
+                               onTransferComplete, this, kKrakenUsbTimeout);
+  ++_num_steps;
+}
+
+void AsyncTransferBatch::addBulkOut(const unsigned char *data,
+                                    const size_t         length) {
+  CHECK(_num_steps < kMaxBatchTransfers) << "Too many transfers in batch";
+  CHECK(length <= kMaxTransferLength) << "Bulk payload too large: " << length;
+  unsigned char *buffer = _buffers[_num_steps];
+  memcpy(buffer, data, length);
+  libusb_fill_bulk_transfer(_transfers[_num_steps], _handle, _endpointOut,
+                            buffer, length, onTransferComplete, this,
+                            kKrakenUsbTimeout);
+  ++_num_steps;
+}
+
+void AsyncTransferBatch::addBulkIn(const size_t length) {
+  CHECK(_num_steps < kMaxBatchTransfers) << "Too many transfers in batch";
+  CHECK(length <= kMaxTransferLength) << "Bulk read too large: " << length;
+  libusb_fill_bulk_transfer(_transfers[_num_steps], _handle, _endpointIn,
+                            _buffers[_num_steps], length, onTransferComplete,
+                            this, kKrakenUsbTimeout);
+  ++_num_steps;
+}
+
+bool AsyncTransferBatch::submit() {
+  if (_state == State::IN_FLIGHT || _num_steps == 0) {
+    return false;
+  }
+  _current_step = 0;
+  _state        = State::IN_FLIGHT;
+  _submitted    = std::chrono::steady_clock::now();
+  if (!submitStep(0)) {
+    _state = State::FAILED;
+  }
+  return true;
+}
+
+AsyncTransferBatch::State AsyncTransferBatch::poll() {
+  const State state = _state;
+  if (state == State::COMPLETED || state == State::FAILED) {
+    _state = State::IDLE;
+  }
+  return state;
+}
+
+/** ********** Private interface ********** */
+
+bool AsyncTransferBatch::submitStep(const size_t step) {
+  const int ret = libusb_submit_transfer(_transfers[step]);
+  LOG_IF(ERROR, ret != 0) << "Failed to submit usb transfer, got: "
+                          << libusb_error_name(ret);
+  return ret == 0;
+}
+
+void AsyncTransferBatch::onTransferComplete(libusb_transfer *transfer) {
+  auto *batch = static_cast<AsyncTransferBatch *>(transfer->user_data);
+  if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+    LOG_IF(ERROR, transfer->status != LIBUSB_TRANSFER_CANCELLED)
+      << "Async usb transfer " << batch->_current_step
+      << " failed with status: " << transfer->status;
+    batch->_state = State::FAILED;
+    return;
+  }
+  if (transfer->endpoint == batch->_endpointIn
+      && transfer->type == LIBUSB_TRANSFER_TYPE_BULK) {
+    memcpy(batch->_last_read, transfer->buffer, transfer->actual_length);
+  }
+  VLOG(2) << "Async transfer " << batch->_current_step << " complete, "
+          << transfer->actual_length << " bytes";
+  if (++batch->_current_step == batch->_num_steps) {
+    batch->_round_trip = std::chrono::steady_clock::now() - batch->_submitted;
+    batch->_state      = State::COMPLETED;
+  } else if (!batch->submitStep(batch->_current_step)) {
+    batch->_state = State::FAILED;
+  }
+}
+
+void AsyncTransferBatch::cancel() {
+  if (_state != State::IN_FLIGHT) {
+    return;
+  }
+  // Callback will flip _state to FAILED once libusb reaps the transfer
+  libusb_cancel_transfer(_transfers[_current_step]);
+  while (_state == State::IN_FLIGHT) {
+    if (libusb_handle_events(NULL) != 0) {
+      break;
+    }
+  }
+  _state = State::IDLE;
+}
+
+void handle_pending_usb_events() {
+  struct timeval zero = {0, 0};
+  const int      ret  = libusb_handle_events_timeout_completed(NULL, &zero, NULL);
+  LOG_IF(WARNING, ret != 0) << "Error handling usb events: "
+                            << libusb_error_name(ret);
+}
@@ -0,0 +1,66 @@
+#ifndef USB_ASYNC_TRANSFER_H
+#define USB_ASYNC_TRANSFER_H
+
+#include <libusb-1.0/libusb.h>
+#include <cstddef>
+#include <cstdint>
+
+#include "constants.h"
+#include "kraken_transport.hpp"
+
+#define kMaxBatchTransfers 8
+#define kMaxTransferLength 64
+
+// A fixed sequence of control writes, bulk writes and bulk reads that is sent
+// to the device without blocking the caller. All libusb_transfer objects and
+// their buffers are allocated once on construction and reused for every batch.
+//
+// The Kraken expects BEGIN, payload and status read in strict order, and those
+// travel on different endpoints, so each step is submitted from the completion
+// callback of the previous one rather than all at once.
+class AsyncTransferBatch : public TransferBatch {
+ public:
+  AsyncTransferBatch(libusb_device_handle *handle,
+                     unsigned char         endpoint_out,
+                     unsigned char         endpoint_in);
+  AsyncTransferBatch(const AsyncTransferBatch &) = delete;
+  ~AsyncTransferBatch() override;
+
+  void clear() override;
+  void addControl(uint16_t value) override;
+  void addBulkOut(const unsigned char *data, const size_t length) override;
+  void addBulkIn(const size_t length) override;
+
+  bool  submit() override;
+  State poll() override;
+  bool  inFlight() const override { return _state == State::IN_FLIGHT; }
+  const unsigned char *lastRead() const override { return _last_read; }
+  std::chrono::steady_clock::duration roundTrip() const override {
+    return _round_trip;
+  }
+
+ private:
+  static void LIBUSB_CALL onTransferComplete(libusb_transfer *transfer);
+  bool submitStep(const size_t step);
+  void cancel();
+
+  libusb_device_handle *const _handle;  // Unowned
+  const unsigned char         _endpointOut;
+  const unsigned char         _endpointIn;
+
+  libusb_transfer *_transfers[kMaxBatchTransfers];
+  unsigned char _buffers[kMaxBatchTransfers]
+                        [LIBUSB_CONTROL_SETUP_SIZE + kMaxTransferLength];
+  unsigned char _last_read[kMaxTransferLength];
+  size_t        _num_steps{0};
+  size_t        _current_step{0};
+  State         _state{State::IDLE};
+
+  std::chrono::steady_clock::time_point _submitted;
+  std::chrono::steady_clock::duration   _round_trip{0};
+};
+
+// Runs completion callbacks of finished transfers, never waits on the bus
+void handle_pending_usb_events();
+
+#endif  // USB_ASYNC_TRANSFER_H
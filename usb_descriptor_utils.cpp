@@ -1,11 +1,11 @@
 #include "usb_descriptor_utils.hpp"
+#include "tick_trace.hpp"
 #include <glog/logging.h>
+#include <stdexcept>
 
 #define kMainConfigurationIndex 0
 #define kMainConfigurationValue 1
 
-#define kKrakenUsbTimeout 5000
-
 bool incoming_endpoint(const libusb_endpoint_descriptor &endpoint) {
   // Or alternatively if this bit operation isn't == 0
   return (endpoint.bEndpointAddress & LIBUSB_ENDPOINT_IN) == LIBUSB_ENDPOINT_IN;
@@ -13,21 +13,36 @@ bool incoming_endpoint(const libusb_endpoint_descriptor &endpoint) {
 
 std::string get_serial_number(libusb_device_descriptor desc,
                               libusb_device_handle *   handle) {
+  if (desc.iSerialNumber == 0) {
+    throw std::runtime_error("Kraken has no serial number string descriptor");
+  }
   unsigned char data[256];
   int no_bytes = libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber,
                                                     data, sizeof(data));
-  return (no_bytes != 0) ? std::string(reinterpret_cast<char *>(data)) : "";
+  if (no_bytes < 0) {
+    throw std::runtime_error(std::string("Failed to read serial number: ")
+                             + libusb_error_name(no_bytes));
+  }
+  if (no_bytes == 0) {
+    throw std::runtime_error("Kraken reported an empty serial number");
+  }
+  return std::string(reinterpret_cast<char *>(data), no_bytes);
 }
 
 libusb_device_descriptor get_descriptor(libusb_device *device) {
   struct libusb_device_descriptor desc = {0};
   int err = libusb_get_device_descriptor(device, &desc);
-  CHECK(err == 0) << "Failed to get descriptor for generic device";
-  CHECK(desc.bNumConfigurations == 1)
-    << "Should only be one configuration descriptor for the kraken";
+  if (err != 0) {
+    throw std::runtime_error(std::string("Failed to get device descriptor: ")
+                             + libusb_error_name(err));
+  }
   CHECK(desc.idVendor == KRAKEN_X61_VENDOR
         && desc.idProduct == KRAKEN_X61_PRODUCT)
     << "This method expects a valid kraken device as its parameter";
+  if (desc.bNumConfigurations != 1) {
+    throw std::runtime_error(
+      "Should only be one configuration descriptor for the kraken");
+  }
   return desc;
 }
 
@@ -36,14 +51,15 @@ libusb_device_handle *get_handle(libusb_device *device) {
   int                   ret    = libusb_open(device, &handle);
   switch (ret) {
   case LIBUSB_ERROR_NO_MEM:
-    LOG(FATAL) << "Out of memory";
+    throw std::runtime_error("Out of memory");
   case LIBUSB_ERROR_ACCESS:
-    LOG(FATAL) << "Insufficient permissions";
+    throw std::runtime_error("Insufficient permissions");
   case LIBUSB_ERROR_NO_DEVICE:
-    LOG(FATAL) << "Device disconnected";
+    throw std::runtime_error("Device disconnected");
   }
   if (LIBUSB_SUCCESS != ret || handle == NULL) {
-    LOG(FATAL) << "ERROR when calling libusb_open";
+    throw std::runtime_error(std::string("ERROR when calling libusb_open: ")
+                             + libusb_error_name(ret));
   }
   return handle;
 }
@@ -52,8 +68,11 @@ libusb_config_descriptor *get_config_descriptor(libusb_device *device) {
   libusb_config_descriptor *config = NULL;
   int                       rc =
     libusb_get_config_descriptor(device, kMainConfigurationIndex, &config);
-  CHECK(rc == 0 && config != NULL) << "Error when retrieving current device "
-                                      "configuration, continuing as normal";
+  if (rc != 0 || config == NULL) {
+    throw std::runtime_error(
+      std::string("Error when retrieving current device configuration: ")
+      + libusb_error_name(rc));
+  }
   return config;
 }
 
@@ -96,15 +115,17 @@ bool transfer_bulk_raw_data(libusb_device_handle *handle,
                             unsigned char         endpoint,
                             unsigned char *       data,
                             size_t                length) {
-  unsigned char *           head              = data;
-  int *                     transferred       = new int;
-  size_t                    bytes_sent        = 0;
+  TraceSpan      span(endpoint & LIBUSB_ENDPOINT_IN ? TraceStage::USB_BULK_IN
+                                                    : TraceStage::USB_BULK_OUT);
+  unsigned char *head        = data;
+  int            transferred = 0;
+  size_t         bytes_sent  = 0;
   while (bytes_sent < length) {
     size_t bytes_to_send = std::min((size_t)64, length - bytes_sent);
     int    ret = libusb_bulk_transfer(handle, endpoint, head, bytes_to_send,
-                                   transferred, kKrakenUsbTimeout);
+                                   &transferred, kKrakenUsbTimeout);
     if (ret == 0) {
-      VLOG(2) << "Success sending packet, " << *transferred << " bytes sent";
+      VLOG(2) << "Success sending packet, " << transferred << " bytes sent";
       bytes_sent += bytes_to_send;
       head = data + bytes_sent;
     } else {
@@ -113,17 +134,17 @@ bool transfer_bulk_raw_data(libusb_device_handle *handle,
       break;
     }
   }
-  delete[] transferred;
   CHECK(bytes_sent <= length) << "Sent more bytes then should have";
   return (bytes_sent == length) ? true : false;
 }
 
 bool transfer_control_value(libusb_device_handle *handle, uint16_t value) {
+  TraceSpan span(TraceStage::USB_CONTROL);
   int ret = libusb_control_transfer(handle, 0x40, 2, value, 0, NULL, 0,
                                   kKrakenUsbTimeout);
-  CHECK(ret == 0) << "Error when performing initialization of device: "
-                << libusb_error_name(ret) << " -- "
-                << libusb_strerror((libusb_error)ret);
+  LOG_IF(ERROR, ret != 0) << "Control transfer " << value
+                          << " failed: " << libusb_error_name(ret) << " -- "
+                          << libusb_strerror((libusb_error)ret);
   return ret == 0;
 }
 
@@ -5,8 +5,12 @@
 
 bool incoming_endpoint(const libusb_endpoint_descriptor &endpoint);
 
+// Identifies the device for its config section and on reconnect. Throws
+// std::runtime_error if it can't be read, e.g. because it was unplugged.
 std::string get_serial_number(libusb_device_descriptor desc,
                               libusb_device_handle *   handle);
+// Throw std::runtime_error if the device can't be queried or opened, e.g.
+// because it was unplugged
 libusb_device_descriptor get_descriptor(libusb_device *device);
 libusb_device_handle *get_handle(libusb_device *device);
 libusb_config_descriptor *get_config_descriptor(libusb_device *device);
@@ -0,0 +1,84 @@
+#include "usb_worker.hpp"
+#include "tick_trace.hpp"
+
+#include <glog/logging.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+UsbWorker::UsbWorker(KrakenDriver &kd) : _kd(kd) {
+  _wake_fd = eventfd(0, EFD_CLOEXEC);
+  PCHECK(_wake_fd >= 0) << "Failed to create eventfd";
+  _thread = std::thread(&UsbWorker::run, this);
+}
+
+UsbWorker::~UsbWorker() {
+  _stop.store(true, std::memory_order_release);
+  const uint64_t one = 1;
+  if (write(_wake_fd, &one, sizeof(one)) != sizeof(one)) {
+    PLOG(ERROR) << "Failed to signal usb worker shutdown";
+  }
+  _thread.join();
+  close(_wake_fd);
+}
+
+void UsbWorker::send(const usb_command &command) {
+  usb_command stamped = command;
+  stamped.sequence    = ++_command_sequence;
+  _command.store(stamped);
+  const uint64_t one = 1;
+  PLOG_IF(ERROR, write(_wake_fd, &one, sizeof(one)) != sizeof(one))
+    << "Failed to wake usb worker";
+}
+
+bool UsbWorker::poll(usb_result &result) {
+  // The sequence is read in the same copy as the result, a separate version
+  // read could pair an older version with a newer result
+  if (!_result.load(result) || result.sequence == _result_sequence) {
+    return false;
+  }
+  _result_sequence = result.sequence;
+  return true;
+}
+
+/** ********** Private interface ********** */
+
+void UsbWorker::run() {
+  uint32_t sent = 0;  // Sequence of the last command sent
+  while (true) {
+    uint64_t wakeups;
+    if (read(_wake_fd, &wakeups, sizeof(wakeups)) < 0 && errno != EINTR) {
+      PLOG(ERROR) << "usb worker failed to wait for commands";
+      return;
+    }
+    if (_stop.load(std::memory_order_acquire)) {
+      return;
+    }
+    usb_command command;
+    if (!_command.load(command) || command.sequence == sent) {
+      continue;
+    }
+    usb_result result = {};
+    result.skipped    = command.sequence - sent - 1;
+    result.sequence   = command.sequence;
+    sent              = command.sequence;
+
+    const uint64_t start = monotonic_ns();
+    _kd.setColor(command.color);
+    result.status.valid = true;
+    if (_kd.colorPending()) {
+      TraceSpan span(TraceStage::COLOR_UPDATE);
+      result.status = _kd.sendColorUpdate();
+    }
+    if (result.status.valid) {
+      TraceSpan span(TraceStage::SPEED_UPDATE);
+      _kd.setFanSpeed(command.fan_duty);
+      _kd.setPumpSpeed(command.pump_duty);
+      result.status = _kd.sendSpeedUpdate();
+    }
+    result.round_trip_ns = monotonic_ns() - start;
+    _result.store(result);
+    if (!result.status.valid) {
+      return;
+    }
+  }
+}
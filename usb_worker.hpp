@@ -0,0 +1,60 @@
+#ifndef USB_WORKER_H
+#define USB_WORKER_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "color_packet.hpp"
+#include "kraken_driver.hpp"
+#include "seqlock.hpp"
+
+// Everything one update sends, color is only sent when it changed
+struct usb_command {
+  ColorPacket color;
+  uint32_t    fan_duty;
+  uint32_t    pump_duty;
+  uint32_t    sequence;  // Set by send(), copied along with the command
+};
+
+struct usb_result {
+  KrakenStatus status;
+  uint64_t     round_trip_ns;
+  uint32_t     skipped;   // Commands overwritten before this one was sent
+  uint32_t     sequence;  // Of the command sent, copied along with the result
+};
+
+// Runs the blocking transfers of one Kraken on its own thread, so a stalled
+// bus never holds up sampling and control. The control loop overwrites the
+// latest command and the thread always sends the most recent one, commands
+// published while a transfer was in progress are skipped. Both directions go
+// through a seqlock, neither side ever waits on the other.
+class UsbWorker {
+ public:
+  // The driver must outlive the worker and isn't touched by anyone else
+  explicit UsbWorker(KrakenDriver &kd);
+  UsbWorker(const UsbWorker &) = delete;
+  // Waits for the transfer in progress, if any
+  ~UsbWorker();
+
+  // Never blocks
+  void send(const usb_command &command);
+  // Returns true if an update finished since the last call. The thread
+  // stops after a failed update (status.valid false), the driver should be
+  // dropped then.
+  bool poll(usb_result &result);
+
+ private:
+  void run();
+
+  KrakenDriver &        _kd;
+  Seqlock<usb_command>  _command;
+  Seqlock<usb_result>   _result;
+  uint32_t              _command_sequence{0};  // Last one sent by send()
+  uint32_t              _result_sequence{0};   // Last one seen by poll()
+  std::atomic<bool>     _stop{false};
+  int                   _wake_fd{-1};  // eventfd, a command or shutdown
+  std::thread           _thread;
+};
+
+#endif  // USB_WORKER_H
@@ -0,0 +1,104 @@
+#include "watchdog.hpp"
+
+#include <glog/logging.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/** ********** ControlWatchdog ********** */
+
+bool ControlWatchdog::update(const tick_health &     health,
+                             const leviathan_config &config) {
+  if (!health.deadline_missed && !health.sensor_failed && !health.usb_stale) {
+    _unhealthy = 0;
+    _causes    = {};
+    if (_full_duty && ++_healthy >= config.failsafe_ticks_) {
+      LOG(INFO) << "Watchdog: healthy again, leaving full duty";
+      _full_duty = false;
+      _reinits   = 0;
+    }
+    return false;
+  }
+  _healthy = 0;
+  ++_unhealthy;
+  _causes.deadline_missed |= health.deadline_missed;
+  _causes.sensor_failed |= health.sensor_failed;
+  _causes.usb_stale |= health.usb_stale;
+  if (_unhealthy == config.failsafe_ticks_) {
+    LOG(ERROR) << "Watchdog: " << _unhealthy << " unhealthy ticks in a row"
+               << (health.deadline_missed ? ", missed deadline" : "")
+               << (health.sensor_failed ? ", sensor failure" : "")
+               << (health.usb_stale ? ", usb stalled" : "")
+               << ", forcing full duty";
+    _full_duty = true;
+  }
+  if (_unhealthy > config.failsafe_ticks_
+      && (_unhealthy - config.failsafe_ticks_) % config.reinit_ticks_ == 0) {
+    ++_reinits;
+    _reinit_causes = _causes;
+    _causes        = {};
+    LOG_IF(ERROR, abandoned())
+      << "Watchdog: " << _reinits
+      << " re-inits didn't help, no longer notifying systemd";
+    return true;
+  }
+  return false;
+}
+
+/** ********** SystemdNotifier ********** */
+
+SystemdNotifier::SystemdNotifier() {
+  const char *const path = getenv("NOTIFY_SOCKET");
+  if (path == NULL || (path[0] != '/' && path[0] != '@')
+      || strlen(path) >= sizeof(_addr.sun_path)) {
+    return;
+  }
+  _fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+  if (_fd < 0) {
+    PLOG(ERROR) << "Failed to create systemd notification socket";
+    return;
+  }
+  memset(&_addr, 0, sizeof(_addr));
+  _addr.sun_family = AF_UNIX;
+  strncpy(_addr.sun_path, path, sizeof(_addr.sun_path) - 1);
+  if (path[0] == '@') {
+    _addr.sun_path[0] = '\0';  // Abstract namespace
+  }
+  _addr_len = offsetof(struct sockaddr_un, sun_path) + strlen(path);
+
+  // Only meant for us if WATCHDOG_PID is unset or our own pid
+  const char *const usec = getenv("WATCHDOG_USEC");
+  const char *const pid  = getenv("WATCHDOG_PID");
+  if (usec != NULL && (pid == NULL || atoi(pid) == getpid())) {
+    _watchdog_interval = std::chrono::microseconds(strtoull(usec, NULL, 10));
+    LOG(INFO) << "systemd watchdog enabled, every "
+              << _watchdog_interval.count() / 1000 << "ms";
+  }
+}
+
+SystemdNotifier::~SystemdNotifier() {
+  if (_fd >= 0) {
+    close(_fd);
+  }
+}
+
+void SystemdNotifier::notify(const char *const state) const {
+  if (_fd < 0) {
+    return;
+  }
+  PLOG_IF(WARNING,
+          sendto(_fd, state, strlen(state), MSG_NOSIGNAL,
+                 reinterpret_cast<const struct sockaddr *>(&_addr), _addr_len)
+            < 0)
+    << "Failed to notify systemd of " << state;
+}
+
+void SystemdNotifier::ping(std::chrono::steady_clock::time_point now) {
+  if (_watchdog_interval.count() == 0
+      || now - _last_ping < _watchdog_interval / 4) {
+    return;
+  }
+  _last_ping = now;
+  notify("WATCHDOG=1");
+}
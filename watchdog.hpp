@@ -0,0 +1,71 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <chrono>
+#include <cstdint>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "leviathan_config.hpp"
+
+// Re-inits that didn't bring the loop back before systemd is left to
+// restart the daemon
+#define kMaxWatchdogReinits 3
+
+// What went wrong in one tick, all false for a healthy one
+struct tick_health {
+  bool deadline_missed;  // Overran its deadline, or ticks were skipped
+  bool sensor_failed;    // CPU or a hwmon sensor read failed
+  bool usb_stale;        // A connected Kraken hasn't reported in time
+};
+
+// Escalates on consecutive unhealthy ticks: full fan and pump duty after
+// failsafe_ticks_, then a re-init every reinit_ticks_ more. Full duty is
+// held until as many healthy ticks in a row as it took to engage it.
+class ControlWatchdog {
+ public:
+  // Feeds the health of the tick that just ran, returns true if sensors and
+  // Krakens should be re-initialized now
+  bool update(const tick_health &health, const leviathan_config &config);
+
+  bool fullDuty() const { return _full_duty; }
+  // Everything that went wrong in the ticks leading up to the last re-init
+  const tick_health &reinitCauses() const { return _reinit_causes; }
+  // Re-inits kept failing, stop reassuring systemd so it restarts the daemon
+  bool abandoned() const { return _reinits >= kMaxWatchdogReinits; }
+
+ private:
+  tick_health _causes{};  // Since the streak began or the last re-init
+  tick_health _reinit_causes{};
+  uint32_t    _unhealthy{0};  // In a row
+  uint32_t    _healthy{0};    // In a row, since full duty engaged
+  uint32_t    _reinits{0};    // Since the last recovery
+  bool        _full_duty{false};
+};
+
+// sd_notify(3) without libsystemd. A no-op unless the daemon was started by
+// systemd with Type=notify.
+class SystemdNotifier {
+ public:
+  SystemdNotifier();
+  SystemdNotifier(const SystemdNotifier &) = delete;
+  ~SystemdNotifier();
+
+  void notify(const char *const state) const;
+  // WATCHDOG=1, at most once per quarter of WatchdogSec
+  void ping(std::chrono::steady_clock::time_point now);
+  // Zero without WatchdogSec
+  std::chrono::microseconds watchdogInterval() const {
+    return _watchdog_interval;
+  }
+
+ private:
+  int                                   _fd{-1};
+  struct sockaddr_un                    _addr;
+  socklen_t                             _addr_len{0};
+  std::chrono::microseconds             _watchdog_interval{0};
+  std::chrono::steady_clock::time_point _last_ping;
+};
+
+#endif  // WATCHDOG_H